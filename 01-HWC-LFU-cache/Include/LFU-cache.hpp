@@ -2,73 +2,307 @@
 #define LFU_CACHE_HPP
 
 #include <iostream>
-#include <unordered_map>
-#include <iterator>
-#include <list>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <string>
+#include <vector>
+#include "cache-slots.hpp"
+#include "cache-stats.hpp"
+#include "cache-snapshot.hpp"
 
-template <typename T, typename KeyT = int>
-struct Cache_t
+// PolicyT orders pages for eviction, see cache-policy.hpp, LFU by default;
+// IndexT maps keys to slots of their pages, see cache-index.hpp; pages are kept in CacheSlots
+template <typename T, typename KeyT = int, template <typename> class PolicyT = LFU, typename IndexT = FlatIndex<KeyT>>
+struct Cache_t : CacheSlots<T, KeyT, PolicyT, IndexT>
 {
-    using ListT  = typename std::list<std::pair<KeyT, std::pair<T, size_t>>>;
-    using ListIt = typename ListT::iterator;
-    using HashT  = typename std::unordered_map<KeyT, ListIt>;
-    using HashIt = typename HashT::iterator;
+    using Slots = CacheSlots<T, KeyT, PolicyT, IndexT>;
+    using Slots::NIL;
+    using Slots::keys_;
+    using Slots::values_;
+    using Slots::policy_;
+    using Slots::hash_t_;
+    using Slots::key_of;
 
-    size_t  size_   ;
-    ListT   cache_  ;
-    HashT   hash_t_ ;
+    static constexpr size_t   PREFETCH_DISTANCE = 8;          // keys between a lookup ahead and the request in update_batch()
+    static constexpr size_t   PREFETCH_MIN_SIZE = 1 << 16;    // smaller caches stay in CPU cache, prefetching only costs
 
-    Cache_t(size_t size) { size_ = size; }
+    size_t                size_      ;
+    T                     uncached_  ;  // value returned by get() when cache size is 0
+    CACHE_STATS_ONLY(CacheStats stats_;)
 
-    bool is_full() const { return (cache_.size() == size_); }
+    // policy_args are passed to the policy constructor after the capacity
+    template <typename... Args>
+    Cache_t(size_t size, Args&&... policy_args) :
+        Slots(size, std::forward<Args>(policy_args)...),
+        size_(size) {}
+
+    bool is_full() const { return (hash_t_.size() == size_); }
 
     void dump()
     {
-        std::cout << "Cache_t dump: \n{\n\tkey :";
-        for (ListIt it = cache_.begin(); it != cache_.end(); ++it) { fprintf(stdout, "%3d", it->first); }
-        std::cout << "\n\tfreq:";
-        for (ListIt it = cache_.begin(); it != cache_.end(); ++it) { fprintf(stdout, "%3ld", it->second.second); }
-        std::cout << "\n}\n\n";
+        std::cout << "Cache_t dump: \n{\n";
+        policy_.dump(key_of());
+        std::cout << "}\n\n";
     }
 
-    bool update(KeyT key)
+    bool update(KeyT key) { return update(key, [](const KeyT&, T&) {}); }
+
+    // the same as update(), a page evicted to make room for the missed one is passed to evicted(key, value)
+    // right before its slot is reused
+    template <typename F>
+    bool update(KeyT key, F evicted)
     {
-        if (size_ == 0) return false;
+        CACHE_STATS_ONLY(ScopedLatency latency(stats_.update_ns);)
+
+        if (size_ == 0)
+        {
+            CACHE_STATS_ONLY(stats_.misses++;)
+            return false;
+        }
 
-        auto hit = hash_t_.find(key);
+        uint32_t hit = hash_t_.find(key, key_of());
 
         // in case page is already in cache
-        if (hit != hash_t_.end())
+        if (hit != NIL)
         {
-            hit->second->second.second++;   // page_frequency++
-
-            if ((hit->second != cache_.begin()) &&
-                (hit->second->second.second > std::prev(hit->second)->second.second))   // if frequency of just added page > frequency of a previous page
-            {
-                cache_.splice(std::prev(hit->second), cache_, hit->second); // swap just added page and that near page
-            }
+            CACHE_STATS_ONLY(stats_.hits++;)
+            policy_.on_hit(hit, key);
 
             // dump();
             return true;
         }
 
         // in case page is not in cache
-        std::pair<KeyT, std::pair<T, size_t>> new_page;
-        new_page.second.second = 1;
-        new_page.first = key;
+        CACHE_STATS_ONLY(stats_.misses++;)
+        insert(key, T(), evicted);
+
+        // dump();
+        return false;
+    }
 
-        if (is_full())  // if cache is full
+    // the same as update() of every key in order, hits[i] is the result for keys[i]; requests are pipelined:
+    // the index group of a key is prefetched 2 * PREFETCH_DISTANCE keys ahead, and PREFETCH_DISTANCE keys
+    // ahead the slot with the matching tag is guessed and its key and policy links are prefetched,
+    // so CPU cache misses of several requests overlap; guesses are only hints and are never trusted
+    void update_batch(const KeyT* keys, size_t n, bool* hits)
+    {
+        if (size_ < PREFETCH_MIN_SIZE)
         {
-            hash_t_.erase(cache_.back().first); // delete the last (the less frequent) page from cache
-            cache_.pop_back();
+            for (size_t i = 0; i < n; i++) hits[i] = update(keys[i]);
+            return;
         }
 
-        cache_.push_back(new_page); // add a new page to cache
-        hash_t_.emplace(key, std::prev(cache_.end()));
+        for (size_t i = 0; i < std::min(n, 2 * PREFETCH_DISTANCE); i++) hash_t_.prefetch(keys[i]);
 
-        // dump();
+        for (size_t i = 0; i < n; i++)
+        {
+            if (i + 2 * PREFETCH_DISTANCE < n) hash_t_.prefetch(keys[i + 2 * PREFETCH_DISTANCE]);
+
+            if (i + PREFETCH_DISTANCE < n)
+            {
+                uint32_t ahead = hash_t_.guess(keys[i + PREFETCH_DISTANCE]);
+                if (ahead != NIL)
+                {
+                    __builtin_prefetch(&keys_[ahead]);
+                    policy_.prefetch(ahead);
+                }
+            }
+
+            hits[i] = update(keys[i]);
+        }
+    }
+
+    // returns cached value of the page or nullptr without counting the page as requested,
+    // doesn't change the cache, so it may be called by several readers at once
+    const T* peek(const KeyT& key) const
+    {
+        uint32_t hit = hash_t_.find(key, key_of());
+        return (hit != NIL) ? &values_[hit] : nullptr;
+    }
+
+    // returns cached value of the page or nullptr, a found page counts as requested
+    T* find(const KeyT& key)
+    {
+        CACHE_STATS_ONLY(ScopedLatency latency(stats_.find_ns);)
+        return lookup(key);
+    }
+
+    // returns cached value of the page, calls loader(key) to get it in case of a miss;
+    // the reference stays valid until the page is evicted or erased
+    template <typename F>
+    T& get(const KeyT& key, F loader)
+    {
+        CACHE_STATS_ONLY(ScopedLatency latency(stats_.get_ns);)
+
+        T* value = lookup(key);
+        if (value) return *value;
+
+        if (size_ == 0) return uncached_ = loader(key);
+
+        return values_[insert(key, loader(key))];
+    }
+
+    // puts value to cache replacing the old one, returns true if the page was already there
+    bool put(const KeyT& key, T value)
+    {
+        CACHE_STATS_ONLY(ScopedLatency latency(stats_.put_ns);)
+
+        T* old_value = lookup(key);
+
+        if (old_value)
+        {
+            *old_value = std::move(value);
+            return true;
+        }
+
+        if (size_ != 0) insert(key, std::move(value));
         return false;
     }
+
+    // removes page from cache, returns false if there was no such page
+    bool erase(const KeyT& key)
+    {
+        CACHE_STATS_ONLY(ScopedLatency latency(stats_.erase_ns);)
+
+        uint32_t slot = hash_t_.find(key, key_of());
+        if (slot == NIL) return false;
+
+        this->erase_slot(slot);
+        CACHE_STATS_ONLY(stats_.erasures++;)
+
+        return true;
+    }
+
+    // bytes taken by the cache besides keys and values
+    size_t metadata_bytes() const
+    {
+        return sizeof(*this) + this->slots_bytes();
+    }
+
+    // writes pages with their ranks in the policy to a binary file, see cache-snapshot.hpp;
+    // keys and values have to be trivially copyable, the policy has to support snapshots (LFU, LRU)
+    void save(const char* path) const
+    {
+        static_assert(std::is_trivially_copyable<KeyT>::value && std::is_trivially_copyable<T>::value,
+                      "only trivially copyable keys and values are saved");
+
+        std::vector<KeyT>     keys;
+        std::vector<uint32_t> ranks;
+        std::vector<T>        values;
+
+        keys  .reserve(hash_t_.size());
+        ranks .reserve(hash_t_.size());
+        values.reserve(hash_t_.size());
+
+        policy_.snapshot([&](uint32_t slot, uint32_t rank)
+        {
+            keys  .push_back(keys_  [slot]);
+            ranks .push_back(rank);
+            values.push_back(values_[slot]);
+        });
+
+        SnapshotHeader header = {};
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.version    = SNAPSHOT_VERSION;
+        header.policy     = PolicyT<KeyT>::SNAPSHOT_ID;
+        header.key_size   = sizeof(KeyT);
+        header.value_size = sizeof(T);
+        header.count      = keys.size();
+
+        SnapshotWriter file(path);
+        file.write(&header,       sizeof(header));
+        file.write(keys.data(),   keys.size()   * sizeof(KeyT));
+        file.write(ranks.data(),  ranks.size()  * sizeof(uint32_t));
+        file.write(values.data(), values.size() * sizeof(T));
+        file.commit();
+    }
+
+    // fills an empty cache from the snapshot written by save() with the same policy and types, so the order
+    // of eviction is the same; if the snapshot has more pages than the capacity, the ones evicted first
+    // are skipped; the file is mapped and copied as is, only the index is built page by page
+    void load(const char* path)
+    {
+        static_assert(std::is_trivially_copyable<KeyT>::value && std::is_trivially_copyable<T>::value,
+                      "only trivially copyable keys and values are loaded");
+
+        if (hash_t_.size() != 0 || !keys_.empty()) throw std::logic_error("snapshot is loaded to a used cache");
+
+        SnapshotMap file(path);
+        file.check(PolicyT<KeyT>::SNAPSHOT_ID, sizeof(KeyT), sizeof(T));
+
+        size_t count = file.header().count;
+        size_t skip  = count - std::min(count, size_);
+        size_t n     = count - skip;
+
+        keys_  .resize(n);
+        values_.resize(n);
+        memcpy(keys_  .data(), file.keys()   + skip * sizeof(KeyT), n * sizeof(KeyT));
+        memcpy(values_.data(), file.values() + skip * sizeof(T),    n * sizeof(T));
+
+        const char* ranks = file.ranks() + skip * sizeof(uint32_t);
+
+        for (uint32_t slot = 0; slot < n; slot++)
+        {
+            uint32_t rank = 0;
+            memcpy(&rank, ranks + slot * sizeof(uint32_t), sizeof(rank));
+
+            if (hash_t_.find(keys_[slot], key_of()) != NIL) throw std::runtime_error("snapshot has a key twice");
+
+            hash_t_.insert(keys_[slot], slot, key_of());
+            policy_.restore(slot, rank);
+        }
+    }
+
+#ifdef CACHE_STATS
+    // snapshot of the counters of the cache and its policy and of latencies of operations
+    CacheStats stats() const
+    {
+        CacheStats stats = stats_;
+        stats.policy = policy_.counters();
+        return stats;
+    }
+
+    std::string stats_json() const { return stats().to_json(); }
+#endif
+
+private:
+    // find() without taking its latency, so get() and put() aren't counted twice
+    T* lookup(const KeyT& key)
+    {
+        uint32_t hit = hash_t_.find(key, key_of());
+
+        if (hit == NIL)
+        {
+            CACHE_STATS_ONLY(stats_.misses++;)
+            return nullptr;
+        }
+
+        CACHE_STATS_ONLY(stats_.hits++;)
+        policy_.on_hit(hit, key);
+        return &values_[hit];
+    }
+
+    // if cache is full, the slot of the page chosen by the policy is reused, so nothing is allocated
+    uint32_t insert(const KeyT& key, T&& value)
+    {
+        auto ignore = [](const KeyT&, T&) {};
+        return insert(key, std::move(value), ignore);
+    }
+
+    template <typename F>
+    uint32_t insert(const KeyT& key, T&& value, F& evicted)
+    {
+        policy_.on_miss(key);
+        CACHE_STATS_ONLY(stats_.insertions++;)
+
+        if (!is_full()) return this->add_page(key, std::move(value));
+
+        CACHE_STATS_ONLY(stats_.evictions++;)
+        return this->reuse_victim(key, std::move(value), evicted);
+    }
 };
 
 #endif
@@ -0,0 +1,439 @@
+#ifndef BUFFERED_CACHE_HPP
+#define BUFFERED_CACHE_HPP
+
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include "LFU-cache.hpp"
+
+// thread-safe cache with deferred frequency promotion whose hits never wait for a lock:
+// cached pages are published in a lock-free table of immutable nodes, a hit finds the node of its key
+// and copies the value while the calling thread is pinned to the current epoch, then records the key
+// in the ring buffer of the thread and counts itself in the counter of the thread. LFU order is kept
+// by Cache_t of keys only, which is changed by misses, put(), erase() and whoever drains the rings,
+// all of them under one mutex. A node or a table taken out of use is freed only when no thread is
+// pinned to the epoch it was taken out in or to an earlier one (epoch based reclamation);
+// recording is lossy: a thread whose ring is full drains all rings only if the mutex is free and
+// drops the key otherwise, so hit counts are exact, while LFU order may miss some hits under contention.
+// The first request of a thread to a cache takes the mutex once to register the ring of the thread,
+// and rings of finished threads stay until the cache is destroyed (a new thread given the same id takes one over)
+template <typename T, typename KeyT = int>
+class BufferedCache
+{
+public:
+    static constexpr size_t BUFFER_SIZE   = 128;
+    static constexpr size_t RECLAIM_BATCH = 64;    // nodes and tables retired before threads are scanned
+
+    struct Stats
+    {
+        size_t hits   = 0;
+        size_t misses = 0;
+    };
+
+private:
+    // pages are never changed in place, put() of a cached page publishes a new node
+    struct Node
+    {
+        KeyT key;
+        T    value;
+    };
+
+    // linear probing over pointers to nodes, a page taken out leaves a tombstone for probes to pass;
+    // a quarter of slots at least is empty, so every probe ends
+    struct Table
+    {
+        size_t                                mask;
+        std::unique_ptr<std::atomic<Node*>[]> slots;
+        size_t                                used = 0;   // slots that aren't empty, changed under the mutex
+
+        explicit Table(size_t capacity) : mask(capacity - 1), slots(new std::atomic<Node*>[capacity])
+        {
+            for (size_t i = 0; i < capacity; i++) slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    // keys of hits are written by the owner thread and read by the drainer under the mutex,
+    // the counters of the ring order them; pinned_ is the epoch the thread reads in, 0 if it doesn't read
+    struct alignas(64) ReadBuffer
+    {
+        std::atomic<uint64_t> pinned_{0};
+        std::atomic<size_t>   hits_{0};
+        std::atomic<size_t>   head_{0};   // written by the owner thread
+        std::atomic<size_t>   tail_{0};   // written by the drainer
+        KeyT                  keys_[BUFFER_SIZE];
+    };
+
+    // keeps the thread pinned to the epoch while it looks into the table
+    class Pin
+    {
+        ReadBuffer& buffer_;
+
+    public:
+        // the epoch is read again after the pin is stored: either reclaim() sees the pin, or that read
+        // sees the epoch reclaim() has started, and so does everything nodes were taken out by before it
+        Pin(ReadBuffer& buffer, const std::atomic<uint64_t>& epoch) : buffer_(buffer)
+        {
+            for (uint64_t pinned = epoch.load(std::memory_order_acquire);;)
+            {
+                buffer_.pinned_.store(pinned, std::memory_order_seq_cst);
+
+                uint64_t current = epoch.load(std::memory_order_seq_cst);
+                if (current == pinned) break;
+
+                pinned = current;
+            }
+        }
+
+        Pin(const Pin&)            = delete;
+        Pin& operator=(const Pin&) = delete;
+
+        ~Pin() { buffer_.pinned_.store(0, std::memory_order_release); }
+    };
+
+    // ids tell caches apart in the memo of thread_buffer(), unlike addresses they are never reused
+    inline static std::atomic<uint64_t> next_id_{1};
+    inline static char                  tombstone_mark_ = 0;
+
+    const uint64_t                                                   id_ = next_id_.fetch_add(1);
+    const size_t                                                     size_;
+    std::mutex                                                       mutex_;
+    Cache_t<char, KeyT>                                              order_;     // LFU order of cached keys
+    std::atomic<Table*>                                              table_;
+    std::atomic<uint64_t>                                            epoch_{1};
+    std::vector<std::pair<uint64_t, Node*>>                          retired_nodes_;   // with epochs they
+    std::vector<std::pair<uint64_t, Table*>>                         retired_tables_;  // were taken out in
+    std::unordered_map<std::thread::id, std::unique_ptr<ReadBuffer>> buffers_;
+    std::atomic<size_t>                                              misses_{0};
+
+    static Node* tombstone() { return reinterpret_cast<Node*>(&tombstone_mark_); }
+
+    static size_t hash(const KeyT& key) { return mix_hash(std::hash<KeyT>()(key)); }
+
+    static size_t table_capacity(size_t size)
+    {
+        size_t capacity = 8;
+        while (capacity < 4 * (size + 1)) capacity *= 2;
+        return capacity;
+    }
+
+    // node of the key or nullptr, a reader has to be pinned
+    static Node* lookup(const Table& table, const KeyT& key)
+    {
+        for (size_t i = hash(key) & table.mask;; i = (i + 1) & table.mask)
+        {
+            Node* node = table.slots[i].load(std::memory_order_acquire);
+
+            if (!node) return nullptr;
+            if (node != tombstone() && node->key == key) return node;
+        }
+    }
+
+    // slot of the cached key in the current table, the rest of the private functions below
+    // are called under the mutex
+    std::atomic<Node*>& slot_of(const KeyT& key)
+    {
+        Table& table = *table_.load(std::memory_order_relaxed);
+
+        for (size_t i = hash(key) & table.mask;; i = (i + 1) & table.mask)
+        {
+            Node* node = table.slots[i].load(std::memory_order_relaxed);
+            if (node && node != tombstone() && node->key == key) return table.slots[i];
+        }
+    }
+
+    static void place(Table& table, Node* node, std::memory_order order)
+    {
+        size_t i = hash(node->key) & table.mask;
+
+        Node* old = nullptr;
+        while ((old = table.slots[i].load(std::memory_order_relaxed)) && old != tombstone()) i = (i + 1) & table.mask;
+
+        if (!old) table.used++;
+        table.slots[i].store(node, order);
+    }
+
+    // tombstones are dropped by copying live nodes to a new table, the old one is retired
+    void rebuild()
+    {
+        Table* old   = table_.load(std::memory_order_relaxed);
+        Table* fresh = new Table(old->mask + 1);
+
+        for (size_t i = 0; i <= old->mask; i++)
+        {
+            Node* node = old->slots[i].load(std::memory_order_relaxed);
+            if (node && node != tombstone()) place(*fresh, node, std::memory_order_relaxed);
+        }
+
+        table_.store(fresh, std::memory_order_release);
+        retired_tables_.emplace_back(epoch_.load(std::memory_order_relaxed), old);
+    }
+
+    // the key of the node must not be in the table
+    void publish(Node* node)
+    {
+        Table& table = *table_.load(std::memory_order_relaxed);
+
+        place(table, node, std::memory_order_release);
+        if (2 * table.used > table.mask + 1) rebuild();
+    }
+
+    void retire(Node* node) { retired_nodes_.emplace_back(epoch_.load(std::memory_order_relaxed), node); }
+
+    void unpublish(const KeyT& key)
+    {
+        std::atomic<Node*>& slot = slot_of(key);
+
+        retire(slot.load(std::memory_order_relaxed));
+        slot.store(tombstone(), std::memory_order_release);
+    }
+
+    // the page goes to LFU order and to the table, the page evicted for it leaves the table;
+    // returns true and leaves the node to its owner if the page is cached already
+    bool admit(std::unique_ptr<Node>& node)
+    {
+        if (order_.update(node->key, [this](const KeyT& victim, char&) { unpublish(victim); })) return true;
+
+        if (size_ != 0) publish(node.release());
+        return false;
+    }
+
+    // frees what no thread can see anymore: a thread pinned to a later epoch than the one a node was
+    // taken out in has loaded the table after that, and so has a thread whose pin isn't seen here
+    void reclaim()
+    {
+        if (retired_nodes_.size() + retired_tables_.size() < RECLAIM_BATCH) return;
+
+        epoch_.fetch_add(1, std::memory_order_seq_cst);
+
+        uint64_t oldest = UINT64_MAX;
+        for (auto& owned : buffers_)
+        {
+            uint64_t pinned = owned.second->pinned_.load(std::memory_order_seq_cst);
+            if (pinned) oldest = std::min(oldest, pinned);
+        }
+
+        auto unseen = [oldest](const auto& retired) { return retired.first < oldest; };
+
+        for (auto& retired : retired_nodes_)  if (unseen(retired)) delete retired.second;
+        for (auto& retired : retired_tables_) if (unseen(retired)) delete retired.second;
+
+        retired_nodes_ .erase(std::remove_if(retired_nodes_ .begin(), retired_nodes_ .end(), unseen), retired_nodes_ .end());
+        retired_tables_.erase(std::remove_if(retired_tables_.begin(), retired_tables_.end(), unseen), retired_tables_.end());
+    }
+
+    // applies buffered hits to LFU order
+    void drain()
+    {
+        for (auto& owned : buffers_)
+        {
+            ReadBuffer& buffer = *owned.second;
+
+            size_t head = buffer.head_.load(std::memory_order_acquire);
+            size_t tail = buffer.tail_.load(std::memory_order_relaxed);
+
+            for (; tail != head; tail++) order_.find(buffer.keys_[tail % BUFFER_SIZE]);
+            buffer.tail_.store(head, std::memory_order_release);
+        }
+    }
+
+    // buffer of the calling thread, created by its first request; a thread remembers the buffer of the
+    // last cache it used, so the map is looked into only when a thread switches between caches,
+    // and only then the mutex is taken. Buffers aren't removed when their threads exit.
+    // Must not be called under the mutex
+    ReadBuffer& thread_buffer()
+    {
+        struct Memo
+        {
+            uint64_t    cache  = 0;
+            ReadBuffer* buffer = nullptr;
+        };
+
+        static thread_local Memo memo;
+        if (memo.cache == id_) return *memo.buffer;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // the id of a finished thread may be given to a new one, which takes over its buffer
+        std::unique_ptr<ReadBuffer>& owned = buffers_[std::this_thread::get_id()];
+        if (!owned) owned.reset(new ReadBuffer);
+
+        memo = {id_, owned.get()};
+        return *owned;
+    }
+
+    // only the owner thread counts its hits, so no read-modify-write is needed
+    static void count_hit(ReadBuffer& buffer)
+    {
+        buffer.hits_.store(buffer.hits_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // drains the rings unless another thread holds the mutex, returns false then
+    bool try_drain()
+    {
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+        if (lock.owns_lock()) drain();
+
+        return lock.owns_lock();
+    }
+
+    // counts the hit and puts its key to the ring of the thread; a full ring is drained first if nobody
+    // holds the mutex, and the key is dropped otherwise; a ring filled by the key is drained the same way
+    void record(ReadBuffer& buffer, const KeyT& key)
+    {
+        count_hit(buffer);
+
+        size_t head = buffer.head_.load(std::memory_order_relaxed);
+
+        if (head - buffer.tail_.load(std::memory_order_acquire) == BUFFER_SIZE && !try_drain()) return;
+
+        buffer.keys_[head % BUFFER_SIZE] = key;
+        buffer.head_.store(head + 1, std::memory_order_release);
+
+        if (head + 1 - buffer.tail_.load(std::memory_order_acquire) == BUFFER_SIZE) try_drain();
+    }
+
+    // lock-free part of a request: returns true and calls on_hit(value) if page is in cache
+    template <typename F>
+    bool read(ReadBuffer& buffer, const KeyT& key, F on_hit)
+    {
+        {
+            Pin pin(buffer, epoch_);
+
+            Node* node = lookup(*table_.load(std::memory_order_acquire), key);
+            if (!node) return false;
+
+            on_hit(node->value);
+        }
+
+        record(buffer, key);
+        return true;
+    }
+
+public:
+    explicit BufferedCache(size_t size) :
+        size_(size),
+        order_(size),
+        table_(new Table(table_capacity(size))) {}
+
+    BufferedCache(const BufferedCache&)            = delete;
+    BufferedCache& operator=(const BufferedCache&) = delete;
+
+    ~BufferedCache()
+    {
+        Table* table = table_.load(std::memory_order_relaxed);
+
+        for (size_t i = 0; i <= table->mask; i++)
+        {
+            Node* node = table->slots[i].load(std::memory_order_relaxed);
+            if (node != tombstone()) delete node;
+        }
+
+        for (auto& retired : retired_nodes_)  delete retired.second;
+        for (auto& retired : retired_tables_) delete retired.second;
+        delete table;
+    }
+
+    bool update(const KeyT& key)
+    {
+        ReadBuffer& buffer = thread_buffer();
+        if (read(buffer, key, [](const T&) {})) return true;
+
+        // the node is made before the mutex is taken, it's dropped if another thread adds the page first
+        std::unique_ptr<Node> node(new Node{key, T()});
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        drain();
+
+        if (admit(node))
+        {
+            count_hit(buffer);
+            return true;
+        }
+
+        misses_.fetch_add(1, std::memory_order_relaxed);
+
+        reclaim();
+        return false;
+    }
+
+    // returns a copy of cached value, loader is called under the mutex
+    template <typename F>
+    T get(const KeyT& key, F loader)
+    {
+        ReadBuffer& buffer = thread_buffer();
+
+        T result;
+        if (read(buffer, key, [&result](const T& value) { result = value; })) return result;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        drain();
+
+        if (order_.find(key))
+        {
+            count_hit(buffer);
+            return slot_of(key).load(std::memory_order_relaxed)->value;
+        }
+
+        misses_.fetch_add(1, std::memory_order_relaxed);
+
+        std::unique_ptr<Node> node(new Node{key, loader(key)});
+        result = node->value;
+
+        admit(node);
+        reclaim();
+        return result;
+    }
+
+    bool put(const KeyT& key, T value)
+    {
+        std::unique_ptr<Node> node(new Node{key, std::move(value)});
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        drain();
+
+        bool hit = admit(node);
+
+        if (hit)
+        {
+            std::atomic<Node*>& slot = slot_of(key);
+
+            retire(slot.load(std::memory_order_relaxed));
+            slot.store(node.release(), std::memory_order_release);
+        }
+
+        reclaim();
+        return hit;
+    }
+
+    bool erase(const KeyT& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        drain();
+
+        bool erased = order_.erase(key);
+        if (erased) unpublish(key);
+
+        reclaim();
+        return erased;
+    }
+
+    Stats stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stats total;
+
+        for (auto& owned : buffers_) total.hits += owned.second->hits_.load(std::memory_order_relaxed);
+        total.misses = misses_.load(std::memory_order_relaxed);
+
+        return total;
+    }
+};
+
+#endif
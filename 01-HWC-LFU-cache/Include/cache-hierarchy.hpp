@@ -0,0 +1,191 @@
+#ifndef CACHE_HIERARCHY_HPP
+#define CACHE_HIERARCHY_HPP
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "LFU-cache.hpp"
+
+// level of CacheHierarchy, Cache_t of keys only with any policy behind one interface
+template <typename KeyT>
+class CacheLevel
+{
+public:
+    virtual ~CacheLevel() = default;
+
+    // request of the key, a missed key is inserted and the key of the page evicted for it is appended to evicted
+    virtual bool update(const KeyT& key, std::vector<KeyT>& evicted) = 0;
+
+    virtual bool   contains(const KeyT& key) const = 0;
+    virtual bool   erase   (const KeyT& key)       = 0;
+    virtual size_t size    ()                const = 0;
+    virtual size_t capacity()                const = 0;
+};
+
+template <typename KeyT, template <typename> class PolicyT>
+class PolicyLevel : public CacheLevel<KeyT>
+{
+    Cache_t<char, KeyT, PolicyT> cache_;
+
+public:
+    explicit PolicyLevel(size_t capacity) : cache_(capacity) {}
+
+    bool update(const KeyT& key, std::vector<KeyT>& evicted) override
+    {
+        return cache_.update(key, [&evicted](const KeyT& victim, char&) { evicted.push_back(victim); });
+    }
+
+    bool   contains(const KeyT& key) const override { return cache_.peek(key) != nullptr; }
+    bool   erase   (const KeyT& key)       override { return cache_.erase(key); }
+    size_t size    ()                const override { return cache_.hash_t_.size(); }
+    size_t capacity()                const override { return cache_.size_; }
+};
+
+// level of the policy of cache-policy.hpp by its name in cache driver: lfu, lru, 2q, arc, tinylfu or gdsf;
+// nullptr if there is no such policy
+template <typename KeyT>
+std::unique_ptr<CacheLevel<KeyT>> make_cache_level(const char* policy, size_t capacity)
+{
+    std::unique_ptr<CacheLevel<KeyT>> level;
+
+    dispatch_policy(policy, [&](auto tag)
+    {
+        level.reset(new PolicyLevel<KeyT, decltype(tag)::template Policy>(capacity));
+    });
+
+    return level;
+}
+
+//     INCLUSIVE - a request goes down until the level that has the page and every level it passed inserts
+//                 the page (promotion); a page evicted from a level is also erased from the levels above
+//                 (back-invalidation), so every level holds all pages of the levels above it
+//     EXCLUSIVE - a page is in one level at most: a hit below the first level takes the page out of its
+//                 level and moves it to the first one, victims of a level are demoted to the next one,
+//                 and victims of the last level leave the hierarchy, so the levels add up their capacities
+enum class Inclusion { INCLUSIVE, EXCLUSIVE };
+
+// chain of cache levels in front of a backend, level 0 is looked into first; requests, hits and the modeled
+// latency are counted per level: a request pays the latency of every level it looks into, and the latency
+// of the backend if no level has the page
+template <typename KeyT = int>
+class CacheHierarchy
+{
+public:
+    struct LevelStats
+    {
+        size_t requests = 0;    // requests that looked into the level
+        size_t hits     = 0;
+    };
+
+private:
+    std::vector<std::unique_ptr<CacheLevel<KeyT>>> levels_;
+    std::vector<double>                            latencies_;
+    std::vector<LevelStats>                        stats_;
+    double                                         backend_latency_;
+    Inclusion                                      inclusion_;
+    size_t                                         n_requests_ = 0;
+    std::vector<KeyT>                              evicted_;
+
+    // the page goes to level 0, victims go down level by level until a level has room for them;
+    // levels of no capacity are passed by
+    void promote(const KeyT& key)
+    {
+        KeyT page = key;
+
+        for (size_t level = 0; level < levels_.size(); level++)
+        {
+            if (levels_[level]->capacity() == 0) continue;
+
+            evicted_.clear();
+            levels_[level]->update(page, evicted_);
+
+            if (evicted_.empty()) return;
+            page = evicted_[0];
+        }
+    }
+
+    size_t request_inclusive(const KeyT& key)
+    {
+        for (size_t level = 0; level < levels_.size(); level++)
+        {
+            evicted_.clear();
+            bool hit = levels_[level]->update(key, evicted_);
+
+            for (const KeyT& victim : evicted_)
+                for (size_t above = 0; above < level; above++) levels_[above]->erase(victim);
+
+            if (hit) return level;
+        }
+
+        return levels_.size();
+    }
+
+    size_t request_exclusive(const KeyT& key)
+    {
+        if (levels_.empty()) return levels_.size();     // no level has the page
+
+        size_t level = 0;
+        while (level < levels_.size() && !levels_[level]->contains(key)) level++;
+
+        if (level == 0)
+        {
+            evicted_.clear();
+            levels_[0]->update(key, evicted_);
+            return 0;
+        }
+
+        // the page leaves its level before it's promoted, so the level has room for a victim from above
+        if (level < levels_.size()) levels_[level]->erase(key);
+
+        promote(key);
+        return level;
+    }
+
+public:
+    // latencies has the latency of every level, backend_latency is paid by requests no level has
+    CacheHierarchy(std::vector<std::unique_ptr<CacheLevel<KeyT>>> levels, std::vector<double> latencies,
+                   double backend_latency, Inclusion inclusion) :
+        levels_(std::move(levels)),
+        latencies_(std::move(latencies)),
+        stats_(levels_.size()),
+        backend_latency_(backend_latency),
+        inclusion_(inclusion)
+    {
+        latencies_.resize(levels_.size(), 0);
+    }
+
+    // returns the level that has the page or the number of levels if none of them has it
+    size_t update(const KeyT& key)
+    {
+        n_requests_++;
+
+        size_t level = (inclusion_ == Inclusion::INCLUSIVE) ? request_inclusive(key) : request_exclusive(key);
+
+        for (size_t passed = 0; passed < std::min(level + 1, levels_.size()); passed++) stats_[passed].requests++;
+        if (level < levels_.size()) stats_[level].hits++;
+
+        return level;
+    }
+
+    size_t n_levels()   const { return levels_.size(); }
+    size_t n_requests() const { return n_requests_; }
+
+    const CacheLevel<KeyT>& level(size_t i) const { return *levels_[i]; }
+    const LevelStats&       stats(size_t i) const { return stats_[i]; }
+
+    // requests that no level had
+    size_t misses() const { return levels_.empty() ? n_requests_ : stats_.back().requests - stats_.back().hits; }
+
+    // mean latency of a request
+    double average_latency() const
+    {
+        if (n_requests_ == 0) return 0;
+
+        double total = misses() * backend_latency_;
+        for (size_t i = 0; i < levels_.size(); i++) total += stats_[i].requests * latencies_[i];
+
+        return total / n_requests_;
+    }
+};
+
+#endif
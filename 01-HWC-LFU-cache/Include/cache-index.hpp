@@ -0,0 +1,357 @@
+#ifndef CACHE_INDEX_HPP
+#define CACHE_INDEX_HPP
+
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Indices map keys of cached pages to their 32-bit slab slots. All of them have the same interface:
+//     find   (key, key_of)          - slot of the key or NIL
+//     insert (key, slot, key_of)    - key must not be in the index
+//     erase  (key, key_of)          - key must be in the index
+//     replace(old_key, key, slot, key_of) - erase old_key and insert key, used on eviction
+//     prefetch(key)                 - hint that the key will be looked up soon
+//     guess(key)                    - likely slot of the key or NIL, cheap and may be wrong
+//     memory_bytes()                - bytes taken by the index
+// key_of(slot) returns key of the page in the slot, so indices don't have to store keys.
+
+// finalizer of MurmurHash3: std::hash of integers is identity, so hashes of neighbouring keys are mixed
+// before their bits pick groups, shards, rows or samples
+inline uint64_t mix_hash(uint64_t h)
+{
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// index on top of std::unordered_map, reuses the hash node of an evicted page for the new one
+template <typename KeyT, typename Hash = std::hash<KeyT>>
+class StdIndex
+{
+    std::unordered_map<KeyT, uint32_t, Hash> map_;
+
+public:
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    StdIndex(size_t capacity) { map_.reserve(capacity); }
+
+    size_t size() const { return map_.size(); }
+
+    // approximate, as node layout is up to the standard library
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + map_.bucket_count() * sizeof(void*) +
+               map_.size() * (sizeof(void*) + sizeof(size_t) + sizeof(std::pair<const KeyT, uint32_t>));
+    }
+
+    // nodes of unordered_map can't be reached without walking the bucket
+    void prefetch(const KeyT&) const {}
+
+    uint32_t guess(const KeyT&) const { return NIL; }
+
+    template <typename KeyOf>
+    uint32_t find(const KeyT& key, KeyOf) const
+    {
+        auto it = map_.find(key);
+        return (it != map_.end()) ? it->second : NIL;
+    }
+
+    template <typename KeyOf>
+    void insert(const KeyT& key, uint32_t slot, KeyOf) { map_.emplace(key, slot); }
+
+    template <typename KeyOf>
+    void erase(const KeyT& key, KeyOf) { map_.erase(key); }
+
+    template <typename KeyOf>
+    void replace(const KeyT& old_key, const KeyT& key, uint32_t slot, KeyOf)
+    {
+        auto node = map_.extract(old_key);
+        node.key()    = key;
+        node.mapped() = slot;
+        map_.insert(std::move(node));
+    }
+};
+
+// open addressing index in the style of SwissTable: slots are split into groups of 16 with a control
+// byte per slot that is either EMPTY, DELETED or 7 bits of the key hash, so a whole group is probed by
+// one SIMD comparison and keys are compared only for matching tags; the table is allocated once for
+// the fixed capacity and never grows, tombstones are dropped by rehashing in place;
+// the number of groups isn't rounded to a power of two, so a table costs 5 / 0.7 bytes per key
+template <typename KeyT, typename Hash = std::hash<KeyT>>
+class FlatIndex
+{
+    static constexpr size_t GROUP   = 16;
+    static constexpr int8_t EMPTY   = -128;
+    static constexpr int8_t DELETED = -2;
+
+    std::vector<int8_t>   ctrl_ ;
+    std::vector<uint32_t> slots_;
+    size_t n_groups_    = 0;
+    size_t size_        = 0;
+    size_t growth_left_ = 0;    // how many EMPTY slots may still be taken before rehashing
+    Hash   hash_;
+
+    size_t hash(const KeyT& key) const { return mix_hash(hash_(key)); }
+
+    static int8_t tag(size_t h) { return h & 0x7f; }
+
+    // maps high bits of the hash to [0, n_groups_) without division
+    size_t group(size_t h) const { return (unsigned __int128)h * n_groups_ >> 64; }
+    size_t next (size_t g) const { return (g + 1 == n_groups_) ? 0 : g + 1; }
+
+    // keys and tombstones together may take up to 7/8 of the table
+    size_t max_load() const { return ctrl_.size() / 8 * 7; }
+
+#ifdef __SSE2__
+    static uint32_t match(const int8_t* group, int8_t byte)
+    {
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(byte), ctrl));
+    }
+
+    static uint32_t match_empty_or_deleted(const int8_t* group)
+    {
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl));
+    }
+#else
+    static uint32_t match(const int8_t* group, int8_t byte)
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP; i++) mask |= uint32_t(group[i] == byte) << i;
+        return mask;
+    }
+
+    static uint32_t match_empty_or_deleted(const int8_t* group)
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP; i++) mask |= uint32_t(group[i] < -1) << i;
+        return mask;
+    }
+#endif
+
+    static constexpr size_t NO_POSITION = SIZE_MAX;
+
+    // position of the key in the table or NO_POSITION
+    template <typename KeyOf>
+    size_t position(const KeyT& key, KeyOf key_of) const
+    {
+        size_t h = hash(key);
+
+        for (size_t g = group(h);; g = next(g))
+        {
+            const int8_t* ctrl = &ctrl_[g * GROUP];
+
+            for (uint32_t m = match(ctrl, tag(h)); m; m &= m - 1)
+            {
+                size_t pos = g * GROUP + __builtin_ctz(m);
+                if (key_of(slots_[pos]) == key) return pos;
+            }
+
+            // nothing was inserted past a group that has an empty slot
+            if (match(ctrl, EMPTY)) return NO_POSITION;
+        }
+    }
+
+    // the first EMPTY or DELETED position in the probe sequence of hash h
+    size_t free_position(size_t h) const
+    {
+        for (size_t g = group(h);; g = next(g))
+        {
+            uint32_t m = match_empty_or_deleted(&ctrl_[g * GROUP]);
+            if (m) return g * GROUP + __builtin_ctz(m);
+        }
+    }
+
+    // distance in groups from the start of the probe sequence of hash h to position pos
+    size_t probe_index(size_t h, size_t pos) const { return (pos / GROUP + n_groups_ - group(h)) % n_groups_; }
+
+    // turns all tombstones into EMPTY slots without allocating: every key is marked DELETED and then
+    // put back either to its place, if it's still in the right group, or to the first free position
+    template <typename KeyOf>
+    void drop_deletes(KeyOf key_of)
+    {
+        for (size_t i = 0; i < ctrl_.size(); i++)
+            ctrl_[i] = (ctrl_[i] == DELETED || ctrl_[i] == EMPTY) ? EMPTY : DELETED;
+
+        for (size_t i = 0; i < ctrl_.size(); i++)
+        {
+            if (ctrl_[i] != DELETED) continue;
+
+            size_t h   = hash(key_of(slots_[i]));
+            size_t pos = free_position(h);
+
+            if (probe_index(h, pos) == probe_index(h, i))
+            {
+                ctrl_[i] = tag(h);
+                continue;
+            }
+
+            if (ctrl_[pos] == EMPTY)
+            {
+                slots_[pos] = slots_[i];
+                ctrl_ [pos] = tag(h);
+                ctrl_ [i]   = EMPTY;
+            }
+            else    // the position is taken by a key that hasn't been put back yet, swap and redo i
+            {
+                std::swap(slots_[pos], slots_[i]);
+                ctrl_[pos] = tag(h);
+                i--;
+            }
+        }
+
+        growth_left_ = max_load() - size_;
+    }
+
+public:
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    FlatIndex(size_t capacity)
+    {
+        // keys take at most 70% of the table, so at least 17.5% of it may be filled by tombstones
+        // before a rehash in place, and rehashes cost O(1) per erase amortized
+        n_groups_ = capacity * 10 / 7 / GROUP + 1;
+        while (n_groups_ * GROUP / 10 * 7 < capacity) n_groups_++;
+
+        ctrl_ .assign(n_groups_ * GROUP, EMPTY);
+        slots_.assign(n_groups_ * GROUP, NIL);
+        growth_left_ = max_load();
+    }
+
+    size_t size() const { return size_; }
+
+    size_t memory_bytes() const { return sizeof(*this) + ctrl_.capacity() + slots_.capacity() * sizeof(uint32_t); }
+
+    // brings control bytes and slots of the first group of the key into CPU cache
+    void prefetch(const KeyT& key) const
+    {
+        size_t g = group(hash(key));
+
+        __builtin_prefetch(&ctrl_ [g * GROUP]);
+        __builtin_prefetch(&slots_[g * GROUP]);
+    }
+
+    // slot of the first tag match in the first group of the key or NIL, keys aren't compared,
+    // so it's the slot of the key unless tags collide or the key was displaced by probing
+    uint32_t guess(const KeyT& key) const
+    {
+        size_t   h = hash(key);
+        size_t   g = group(h);
+        uint32_t m = match(&ctrl_[g * GROUP], tag(h));
+
+        return m ? slots_[g * GROUP + __builtin_ctz(m)] : NIL;
+    }
+
+    template <typename KeyOf>
+    uint32_t find(const KeyT& key, KeyOf key_of) const
+    {
+        size_t pos = position(key, key_of);
+        return (pos != NO_POSITION) ? slots_[pos] : NIL;
+    }
+
+    template <typename KeyOf>
+    void insert(const KeyT& key, uint32_t slot, KeyOf key_of)
+    {
+        if (growth_left_ == 0) drop_deletes(key_of);
+
+        size_t h   = hash(key);
+        size_t pos = free_position(h);
+
+        if (ctrl_[pos] == EMPTY) growth_left_--;
+
+        ctrl_ [pos] = tag(h);
+        slots_[pos] = slot;
+        size_++;
+    }
+
+    template <typename KeyOf>
+    void erase(const KeyT& key, KeyOf key_of)
+    {
+        size_t pos = position(key, key_of);
+        size_t g   = pos / GROUP;
+
+        // if the group has an empty slot, no probe sequence has ever passed it,
+        // so the slot may become EMPTY instead of a tombstone
+        if (match(&ctrl_[g * GROUP], EMPTY))
+        {
+            ctrl_[pos] = EMPTY;
+            growth_left_++;
+        }
+        else ctrl_[pos] = DELETED;
+
+        size_--;
+    }
+
+    template <typename KeyOf>
+    void replace(const KeyT& old_key, const KeyT& key, uint32_t slot, KeyOf key_of)
+    {
+        erase (old_key, key_of);
+        insert(key, slot, key_of);
+    }
+};
+
+// index of dense keys, ids 0 ... U-1 of a remapped trace (see dense-keys.hpp): the slot of a key is
+// the element of an array at the key itself, so a lookup is one load and nothing is hashed or compared;
+// the array grows to the greatest key inserted, so it takes 4 bytes per key of the universe
+template <typename KeyT>
+class DenseIndex
+{
+    static_assert(std::is_unsigned<KeyT>::value, "keys of DenseIndex are dense unsigned ids");
+
+    std::vector<uint32_t> slots_;
+    size_t size_ = 0;
+
+public:
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    DenseIndex(size_t) {}
+
+    size_t size() const { return size_; }
+
+    size_t memory_bytes() const { return sizeof(*this) + slots_.capacity() * sizeof(uint32_t); }
+
+    void prefetch(const KeyT& key) const
+    {
+        if (key < slots_.size()) __builtin_prefetch(&slots_[key]);
+    }
+
+    // the lookup is exact and as cheap as a guess
+    uint32_t guess(const KeyT& key) const { return (key < slots_.size()) ? slots_[key] : NIL; }
+
+    template <typename KeyOf>
+    uint32_t find(const KeyT& key, KeyOf) const { return guess(key); }
+
+    template <typename KeyOf>
+    void insert(const KeyT& key, uint32_t slot, KeyOf)
+    {
+        if (key >= slots_.size()) slots_.resize(std::max<size_t>(size_t(key) + 1, 2 * slots_.size()), NIL);
+
+        slots_[key] = slot;
+        size_++;
+    }
+
+    template <typename KeyOf>
+    void erase(const KeyT& key, KeyOf)
+    {
+        slots_[key] = NIL;
+        size_--;
+    }
+
+    template <typename KeyOf>
+    void replace(const KeyT& old_key, const KeyT& key, uint32_t slot, KeyOf key_of)
+    {
+        erase (old_key, key_of);
+        insert(key, slot, key_of);
+    }
+};
+
+#endif
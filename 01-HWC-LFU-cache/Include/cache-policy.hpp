@@ -0,0 +1,1052 @@
+#ifndef CACHE_POLICY_HPP
+#define CACHE_POLICY_HPP
+
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "cache-index.hpp"
+#include "frequency-sketch.hpp"
+#include "cache-stats.hpp"
+
+// Eviction policies of Cache_t. Cache_t keeps keys and values in 32-bit slots, a policy only orders
+// the slots. Policies are templates of the key type with the same interface:
+//     Policy(capacity)
+//     on_hit   (slot, key)   - page in the slot is requested
+//     on_miss  (key)         - a missed page is going to be inserted, called before victim()
+//     victim   (key_of)      - cache is full: unlink and return slot of the page to evict
+//     on_insert(slot, key)   - the missed page is put to the slot
+//     on_erase (slot)        - page in the slot is removed by user
+//     on_weight(slot, weight)- weighted caches only: weight of the page in the slot is set, pages weigh 1 until then
+//     prefetch (slot)        - hint that page in the slot will be requested soon
+//     dump     (key_of)      - print the order of pages
+//     memory_bytes()         - bytes taken by the policy
+//     counters()             - with CACHE_STATS, events of the policy, see cache-stats.hpp
+// LFU and LRU may also be saved to a snapshot and restored from it, see Cache_t::save():
+//     SNAPSHOT_ID            - tag of the policy in snapshot files
+//     snapshot (visit)       - visit(slot, rank) for every page in the order of eviction
+//     restore  (slot, rank)  - on an empty policy: append the page, pages come in the order of snapshot()
+// key_of(slot) returns key of the page in the slot.
+
+constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+// links of intrusive lists of slots, a slot is in one list at most
+struct SlotLinks
+{
+    std::vector<uint32_t> prev_;
+    std::vector<uint32_t> next_;
+
+    SlotLinks(size_t capacity)
+    {
+        prev_.reserve(capacity);
+        next_.reserve(capacity);
+    }
+
+    // Cache_t gives out slots one by one, so links grow along with them
+    void fit(uint32_t slot)
+    {
+        if (slot < prev_.size()) return;
+
+        prev_.resize(slot + 1, NO_SLOT);
+        next_.resize(slot + 1, NO_SLOT);
+    }
+
+    void prefetch(uint32_t slot) const
+    {
+        __builtin_prefetch(&prev_[slot]);
+        __builtin_prefetch(&next_[slot]);
+    }
+
+    size_t memory_bytes() const { return (prev_.capacity() + next_.capacity()) * sizeof(uint32_t); }
+};
+
+// intrusive doubly linked list of slots, the oldest slot is at head
+struct SlotList
+{
+    uint32_t head = NO_SLOT;
+    uint32_t tail = NO_SLOT;
+    size_t   size = 0;
+
+    void push_back(SlotLinks& links, uint32_t slot)
+    {
+        links.prev_[slot] = tail;
+        links.next_[slot] = NO_SLOT;
+
+        if (tail != NO_SLOT) links.next_[tail] = slot;
+        else                 head = slot;
+        tail = slot;
+        size++;
+    }
+
+    void remove(SlotLinks& links, uint32_t slot)
+    {
+        uint32_t prev = links.prev_[slot];
+        uint32_t next = links.next_[slot];
+
+        if (prev != NO_SLOT) links.next_[prev] = next;
+        else                 head = next;
+
+        if (next != NO_SLOT) links.prev_[next] = prev;
+        else                 tail = prev;
+        size--;
+    }
+
+    uint32_t pop_front(SlotLinks& links)
+    {
+        uint32_t slot = head;
+        remove(links, slot);
+        return slot;
+    }
+
+    template <typename KeyOf>
+    void dump(const char* name, const SlotLinks& links, KeyOf key_of) const
+    {
+        fprintf(stdout, "\t%-8s:", name);
+        for (uint32_t slot = head; slot != NO_SLOT; slot = links.next_[slot]) { std::cout << " " << key_of(slot); }
+        std::cout << "\n";
+    }
+};
+
+// keys of recently evicted pages in the order of eviction, the oldest key is forgotten when it's full
+template <typename KeyT>
+class GhostList
+{
+    size_t            capacity_;
+    std::vector<KeyT> keys_ ;
+    SlotLinks         links_;
+    SlotList          order_;
+    SlotList          free_ ;
+    FlatIndex<KeyT>   index_;
+
+    auto key_of() const { return [this](uint32_t slot) -> const KeyT& { return keys_[slot]; }; }
+
+    void release(uint32_t slot)
+    {
+        order_.remove(links_, slot);
+        free_.push_back(links_, slot);
+    }
+
+public:
+    GhostList(size_t capacity) : capacity_(capacity), links_(capacity), index_(capacity) { keys_.reserve(capacity); }
+
+    size_t size() const { return order_.size; }
+
+    bool contains(const KeyT& key) const { return index_.find(key, key_of()) != NO_SLOT; }
+
+    bool remove(const KeyT& key)
+    {
+        uint32_t slot = index_.find(key, key_of());
+        if (slot == NO_SLOT) return false;
+
+        index_.erase(key, key_of());
+        release(slot);
+        return true;
+    }
+
+    void pop_front()
+    {
+        index_.erase(keys_[order_.head], key_of());
+        release(order_.head);
+    }
+
+    void push_back(const KeyT& key)
+    {
+        if (capacity_ == 0) return;
+        if (order_.size == capacity_) pop_front();
+
+        uint32_t slot = 0;
+
+        if (free_.size) slot = free_.pop_front(links_);
+        else
+        {
+            slot = keys_.size();
+            keys_.push_back(key);
+            links_.fit(slot);
+        }
+
+        keys_[slot] = key;
+        index_.insert(key, slot, key_of());
+        order_.push_back(links_, slot);
+    }
+
+    void dump(const char* name) const { order_.dump(name, links_, key_of()); }
+
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + keys_.capacity() * sizeof(KeyT) + links_.memory_bytes() + index_.memory_bytes();
+    }
+};
+
+// evicts the least recently used page
+template <typename KeyT>
+class LRU
+{
+    SlotLinks links_;
+    SlotList  order_;
+    CACHE_STATS_ONLY(PolicyCounters counters_;)
+
+public:
+    static constexpr uint32_t SNAPSHOT_ID = 2;
+
+    LRU(size_t capacity) : links_(capacity) {}
+
+    void on_hit(uint32_t slot, const KeyT&)
+    {
+        order_.remove(links_, slot);
+        order_.push_back(links_, slot);
+        CACHE_STATS_ONLY(counters_.splices++;)
+    }
+
+    void on_miss(const KeyT&) {}
+
+    template <typename KeyOf>
+    uint32_t victim(KeyOf) { return order_.pop_front(links_); }
+
+    void on_insert(uint32_t slot, const KeyT&)
+    {
+        links_.fit(slot);
+        order_.push_back(links_, slot);
+    }
+
+    void on_erase(uint32_t slot) { order_.remove(links_, slot); }
+
+    void on_weight(uint32_t, size_t) {}
+
+    void prefetch(uint32_t slot) const { links_.prefetch(slot); }
+
+    template <typename KeyOf>
+    void dump(KeyOf key_of) const { order_.dump("LRU", links_, key_of); }
+
+    template <typename F>
+    void snapshot(F visit) const
+    {
+        for (uint32_t slot = order_.head; slot != NO_SLOT; slot = links_.next_[slot]) visit(slot, 0);
+    }
+
+    void restore(uint32_t slot, uint32_t)
+    {
+        links_.fit(slot);
+        order_.push_back(links_, slot);
+    }
+
+    CACHE_STATS_ONLY(const PolicyCounters& counters() const { return counters_; })
+
+    size_t memory_bytes() const { return sizeof(*this) + links_.memory_bytes(); }
+};
+
+// evicts the least recently used page of the least frequent ones in O(1):
+// pages with the same frequency are kept in buckets in the order of recency,
+// buckets form a list sorted by frequency;
+// with aging all frequencies are halved every aging_period requests, so pages that were popular long ago
+// may be evicted. An epoch of aging is spread over the following requests with aging_step units of work
+// on each: buckets are halved one by one from the least frequent, a bucket that gets the frequency of the
+// previous one is spliced to its end and forwards to it, then slots of pages are pointed to the buckets
+// they were forwarded to, and only then forwarded buckets are freed and the next epoch may start
+template <typename KeyT>
+class LFU
+{
+public:
+    static constexpr uint32_t NIL      = NO_SLOT;
+    static constexpr uint32_t MAX_FREQ = UINT32_MAX;    // frequencies saturate at it
+
+    static constexpr uint32_t SNAPSHOT_ID = 1;
+
+    struct FreqNode
+    {
+        uint32_t freq;
+        uint32_t head;
+        uint32_t tail;
+        uint32_t prev;
+        uint32_t next;      // also links free buckets
+        uint32_t forward;   // bucket the pages were spliced to by aging or NIL
+    };
+
+private:
+    std::vector<uint32_t> freq_ ;   // bucket of the page in the slot
+    SlotLinks             links_;
+    std::vector<FreqNode> freqs_;   // grows up to the largest number of buckets used at once
+    uint32_t              free_freq_  = NIL;
+    uint32_t              first_freq_ = NIL;    // the least frequent bucket
+
+    enum Aging { IDLE, HALVING, REPOINTING };
+
+    size_t                aging_period_;        // requests between halvings, 0 turns aging off
+    size_t                aging_step_;          // buckets or slots processed on a request
+    size_t                since_epoch_ = 0;
+    Aging                 aging_ = IDLE;
+    uint32_t              sweep_ = NIL;         // next bucket to halve
+    size_t                pass_  = 0;           // next slot to point to its bucket
+    std::vector<uint32_t> forwarded_;           // buckets to free after the pass over slots
+    CACHE_STATS_ONLY(PolicyCounters counters_;)
+
+    // bucket of the page, forwarding is never longer than one hop
+    uint32_t bucket(uint32_t page) const
+    {
+        uint32_t freq = freq_[page];
+        return (freqs_[freq].forward != NIL) ? freqs_[freq].forward : freq;
+    }
+
+    // append page to the most recent end of the bucket
+    void link_page(uint32_t freq, uint32_t page)
+    {
+        FreqNode& bucket = freqs_[freq];
+
+        freq_[page]        = freq;
+        links_.prev_[page] = bucket.tail;
+        links_.next_[page] = NIL;
+
+        if (bucket.tail != NIL) links_.next_[bucket.tail] = page;
+        else                    bucket.head = page;
+        bucket.tail = page;
+    }
+
+    // unlink page from its bucket, the bucket is deleted if it becomes empty
+    void unlink_page(uint32_t page)
+    {
+        uint32_t  freq   = bucket(page);
+        FreqNode& bucket = freqs_[freq];
+        uint32_t  prev   = links_.prev_[page];
+        uint32_t  next   = links_.next_[page];
+
+        if (prev != NIL) links_.next_[prev] = next;
+        else             bucket.head = next;
+
+        if (next != NIL) links_.prev_[next] = prev;
+        else             bucket.tail = prev;
+
+        if (bucket.head == NIL) delete_freq(freq);
+    }
+
+    // create an empty bucket right after bucket prev or at front if prev is NIL
+    uint32_t new_freq(uint32_t freq, uint32_t prev)
+    {
+        uint32_t next = (prev != NIL) ? freqs_[prev].next : first_freq_;
+        uint32_t node = 0;
+
+        if (free_freq_ != NIL)
+        {
+            node = free_freq_;
+            free_freq_ = freqs_[node].next;
+            freqs_[node] = FreqNode{freq, NIL, NIL, prev, next, NIL};
+        }
+        else
+        {
+            node = freqs_.size();
+            freqs_.push_back(FreqNode{freq, NIL, NIL, prev, next, NIL});
+        }
+
+        if (prev != NIL) freqs_[prev].next = node;
+        else             first_freq_ = node;
+
+        if (next != NIL) freqs_[next].prev = node;
+
+        return node;
+    }
+
+    void delete_freq(uint32_t freq)
+    {
+        FreqNode& bucket = freqs_[freq];
+
+        if (freq == sweep_) sweep_ = bucket.next;
+
+        if (bucket.prev != NIL) freqs_[bucket.prev].next = bucket.next;
+        else                    first_freq_ = bucket.next;
+
+        if (bucket.next != NIL) freqs_[bucket.next].prev = bucket.prev;
+
+        bucket.next = free_freq_;
+        free_freq_  = freq;
+    }
+
+    // halves the frequency of the next bucket of the sweep; the halved part of the list stays sorted, as
+    // its frequencies are at most halves of the rest, but a hit may have put a bucket of a greater
+    // frequency right before the swept one, so the swept bucket is spliced to any not less frequent one
+    void halve_bucket()
+    {
+        uint32_t  freq = sweep_;
+        FreqNode& node = freqs_[freq];
+        uint32_t  prev = node.prev;
+        uint32_t  half = std::max<uint32_t>(node.freq / 2, 1);
+
+        sweep_ = node.next;
+
+        if (prev == NIL || freqs_[prev].freq < half)
+        {
+            node.freq = half;
+            return;
+        }
+
+        FreqNode& to = freqs_[prev];
+
+        links_.next_[to.tail]   = node.head;
+        links_.prev_[node.head] = to.tail;
+        to.tail = node.tail;
+
+        to.next = node.next;
+        if (node.next != NIL) freqs_[node.next].prev = prev;
+
+        node.forward = prev;
+        forwarded_.push_back(freq);
+        CACHE_STATS_ONLY(counters_.splices++;)
+    }
+
+    void finish_epoch()
+    {
+        for (uint32_t freq : forwarded_)
+        {
+            freqs_[freq].forward = NIL;
+            freqs_[freq].next    = free_freq_;
+            free_freq_ = freq;
+        }
+
+        forwarded_.clear();
+        aging_ = IDLE;
+    }
+
+    // called on every request
+    void age()
+    {
+        if (aging_period_ == 0) return;
+
+        if (++since_epoch_ >= aging_period_ && aging_ == IDLE)
+        {
+            since_epoch_ = 0;
+            aging_ = HALVING;
+            sweep_ = first_freq_;
+        }
+
+        size_t work = aging_step_;
+
+        for (; work && aging_ == HALVING; work--)
+        {
+            if (sweep_ != NIL) halve_bucket();
+            else
+            {
+                aging_ = REPOINTING;
+                pass_  = 0;
+            }
+        }
+
+        for (; work && aging_ == REPOINTING; work--)
+        {
+            if (pass_ == freq_.size()) finish_epoch();
+            else
+            {
+                if (freq_[pass_] != NIL) freq_[pass_] = bucket(pass_);
+                pass_++;
+            }
+        }
+    }
+
+public:
+    // an epoch takes at most 2 * capacity + 2 units of work, by default it's spread over aging_period requests
+    LFU(size_t capacity, size_t aging_period = 0, size_t aging_step = 0) :
+        links_(capacity),
+        aging_period_(aging_period),
+        aging_step_(aging_step ? aging_step : aging_period ? (2 * capacity + 2) / aging_period + 1 : 0)
+    {
+        freq_.reserve(capacity);
+    }
+
+    // move page to the bucket of frequency + 1, creating it right after the current one if needed;
+    // pages of the saturated frequency only move to the most recent end of their bucket
+    void on_hit(uint32_t page, const KeyT&)
+    {
+        age();
+
+        uint32_t cur  = bucket(page);
+        uint32_t next = cur;
+
+        if (freqs_[cur].freq != MAX_FREQ)
+        {
+            next = freqs_[cur].next;
+
+            if (next == NIL || freqs_[next].freq != freqs_[cur].freq + 1)
+                next = new_freq(freqs_[cur].freq + 1, cur);
+        }
+        else if (freqs_[cur].head == freqs_[cur].tail) return;
+
+        CACHE_STATS_ONLY((next != cur) ? counters_.bucket_moves++ : counters_.splices++;)
+
+        unlink_page(page);
+        link_page(next, page);
+    }
+
+    void on_miss(const KeyT&) { age(); }
+
+    // the least recently used page of the least frequent bucket
+    template <typename KeyOf>
+    uint32_t victim(KeyOf)
+    {
+        uint32_t page = freqs_[first_freq_].head;
+        unlink_page(page);
+        return page;
+    }
+
+    // add a new page to the most recent end of bucket 1
+    void on_insert(uint32_t page, const KeyT&)
+    {
+        if (page >= freq_.size()) freq_.resize(page + 1, NIL);
+        links_.fit(page);
+
+        uint32_t first = first_freq_;
+        if (first == NIL || freqs_[first].freq != 1)
+            first = new_freq(1, NIL);
+
+        link_page(first, page);
+    }
+
+    void on_erase(uint32_t page) { unlink_page(page); }
+
+    void on_weight(uint32_t, size_t) {}
+
+    void prefetch(uint32_t page) const
+    {
+        __builtin_prefetch(&freq_[page]);
+        links_.prefetch(page);
+    }
+
+    template <typename KeyOf>
+    void dump(KeyOf key_of) const
+    {
+        for (uint32_t freq = first_freq_; freq != NIL; freq = freqs_[freq].next)
+        {
+            fprintf(stdout, "\tfreq %3u:", freqs_[freq].freq);
+            for (uint32_t page = freqs_[freq].head; page != NIL; page = links_.next_[page]) { std::cout << " " << key_of(page); }
+            std::cout << "\n";
+        }
+    }
+
+    CACHE_STATS_ONLY(const PolicyCounters& counters() const { return counters_; })
+
+    // rank is the frequency, buckets forwarded by aging in progress are already spliced to the right ones
+    template <typename F>
+    void snapshot(F visit) const
+    {
+        for (uint32_t freq = first_freq_; freq != NIL; freq = freqs_[freq].next)
+            for (uint32_t page = freqs_[freq].head; page != NIL; page = links_.next_[page]) visit(page, freqs_[freq].freq);
+    }
+
+    // buckets of an empty policy are allocated one after another, so the last one is the most frequent;
+    // aging starts a new period
+    void restore(uint32_t page, uint32_t freq)
+    {
+        if (page >= freq_.size()) freq_.resize(page + 1, NIL);
+        links_.fit(page);
+
+        uint32_t last = freqs_.empty() ? NIL : uint32_t(freqs_.size() - 1);
+        if (last == NIL || freqs_[last].freq != freq)
+            last = new_freq(freq, last);
+
+        link_page(last, page);
+    }
+
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + (freq_.capacity() + forwarded_.capacity()) * sizeof(uint32_t) +
+               links_.memory_bytes() + freqs_.capacity() * sizeof(FreqNode);
+    }
+};
+
+// 2Q by Johnson and Shasha: new pages go to FIFO A1in, pages evicted from A1in are remembered in
+// ghost FIFO A1out, and only pages requested again while in A1out are admitted to LRU Am,
+// so a single scan doesn't flush frequently used pages
+template <typename KeyT>
+class TwoQ
+{
+    size_t               kin_;      // size of A1in, 25% of capacity
+    SlotLinks            links_;
+    SlotList             a1in_;
+    SlotList             am_;
+    std::vector<uint8_t> in_am_;
+    GhostList<KeyT>      a1out_;    // 50% of capacity
+    bool                 to_am_ = false;
+    CACHE_STATS_ONLY(PolicyCounters counters_;)
+
+public:
+    TwoQ(size_t capacity) :
+        kin_(std::max<size_t>(capacity / 4, 1)),
+        links_(capacity),
+        a1out_(std::max<size_t>(capacity / 2, 1)) { in_am_.reserve(capacity); }
+
+    // pages in A1in stay in FIFO order
+    void on_hit(uint32_t slot, const KeyT&)
+    {
+        if (!in_am_[slot]) return;
+
+        am_.remove(links_, slot);
+        am_.push_back(links_, slot);
+        CACHE_STATS_ONLY(counters_.splices++;)
+    }
+
+    void on_miss(const KeyT& key) { to_am_ = a1out_.remove(key); }
+
+    template <typename KeyOf>
+    uint32_t victim(KeyOf key_of)
+    {
+        if (a1in_.size > kin_ || am_.size == 0)
+        {
+            uint32_t slot = a1in_.pop_front(links_);
+            a1out_.push_back(key_of(slot));
+            return slot;
+        }
+
+        return am_.pop_front(links_);
+    }
+
+    void on_insert(uint32_t slot, const KeyT&)
+    {
+        links_.fit(slot);
+        if (slot >= in_am_.size()) in_am_.resize(slot + 1);
+
+        in_am_[slot] = to_am_;
+        (to_am_ ? am_ : a1in_).push_back(links_, slot);
+        to_am_ = false;
+    }
+
+    void on_erase(uint32_t slot) { (in_am_[slot] ? am_ : a1in_).remove(links_, slot); }
+
+    void on_weight(uint32_t, size_t) {}
+
+    void prefetch(uint32_t slot) const
+    {
+        __builtin_prefetch(&in_am_[slot]);
+        links_.prefetch(slot);
+    }
+
+    template <typename KeyOf>
+    void dump(KeyOf key_of) const
+    {
+        a1in_.dump("A1in", links_, key_of);
+        am_  .dump("Am",   links_, key_of);
+        a1out_.dump("A1out");
+    }
+
+    CACHE_STATS_ONLY(const PolicyCounters& counters() const { return counters_; })
+
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + links_.memory_bytes() + in_am_.capacity() + a1out_.memory_bytes();
+    }
+};
+
+// ARC by Megiddo and Modha: T1 keeps pages requested once and T2 pages requested at least twice,
+// ghost lists B1 and B2 remember pages evicted from them, and the target size p of T1 adapts
+// to hits in the ghosts, balancing between recency and frequency
+template <typename KeyT>
+class ARC
+{
+    size_t               c_;
+    size_t               p_ = 0;
+    SlotLinks            links_;
+    SlotList             t1_;
+    SlotList             t2_;
+    std::vector<uint8_t> in_t2_;
+    GhostList<KeyT>      b1_;
+    GhostList<KeyT>      b2_;
+
+    // what on_miss() found out about the missed page
+    bool to_t2_   = false;  // it was in B1 or B2
+    bool from_b2_ = false;  // it was in B2
+    bool drop_t1_ = false;  // L1 is full and B1 is empty, so LRU page of T1 is evicted without a ghost
+
+    CACHE_STATS_ONLY(PolicyCounters counters_;)
+
+public:
+    ARC(size_t capacity) : c_(capacity), links_(capacity), b1_(capacity), b2_(capacity) { in_t2_.reserve(capacity); }
+
+    void on_hit(uint32_t slot, const KeyT&)
+    {
+        CACHE_STATS_ONLY(in_t2_[slot] ? counters_.splices++ : counters_.promotions++;)
+
+        (in_t2_[slot] ? t2_ : t1_).remove(links_, slot);
+        t2_.push_back(links_, slot);
+        in_t2_[slot] = true;
+    }
+
+    void on_miss(const KeyT& key)
+    {
+        to_t2_ = from_b2_ = drop_t1_ = false;
+
+        if (b1_.contains(key))
+        {
+            p_ = std::min(c_, p_ + std::max<size_t>(b2_.size() / b1_.size(), 1));
+            b1_.remove(key);
+            to_t2_ = true;
+        }
+        else if (b2_.contains(key))
+        {
+            p_ -= std::min(p_, std::max<size_t>(b1_.size() / b2_.size(), 1));
+            b2_.remove(key);
+            to_t2_ = from_b2_ = true;
+        }
+        else
+        {
+            size_t l1    = t1_.size + b1_.size();
+            size_t total = l1 + t2_.size + b2_.size();
+
+            if (l1 >= c_)
+            {
+                if (t1_.size < c_) b1_.pop_front();
+                else               drop_t1_ = true;
+            }
+            else if (total >= 2 * c_ && b2_.size()) b2_.pop_front();
+        }
+    }
+
+    // REPLACE of the original paper
+    template <typename KeyOf>
+    uint32_t victim(KeyOf key_of)
+    {
+        if (drop_t1_)
+        {
+            drop_t1_ = false;
+            return t1_.pop_front(links_);
+        }
+
+        if (t1_.size && ((from_b2_ && t1_.size == p_) || t1_.size > p_ || t2_.size == 0))
+        {
+            uint32_t slot = t1_.pop_front(links_);
+            b1_.push_back(key_of(slot));
+            return slot;
+        }
+
+        uint32_t slot = t2_.pop_front(links_);
+        b2_.push_back(key_of(slot));
+        return slot;
+    }
+
+    void on_insert(uint32_t slot, const KeyT&)
+    {
+        links_.fit(slot);
+        if (slot >= in_t2_.size()) in_t2_.resize(slot + 1);
+
+        in_t2_[slot] = to_t2_;
+        (to_t2_ ? t2_ : t1_).push_back(links_, slot);
+        to_t2_ = from_b2_ = drop_t1_ = false;
+    }
+
+    void on_erase(uint32_t slot) { (in_t2_[slot] ? t2_ : t1_).remove(links_, slot); }
+
+    void on_weight(uint32_t, size_t) {}
+
+    void prefetch(uint32_t slot) const
+    {
+        __builtin_prefetch(&in_t2_[slot]);
+        links_.prefetch(slot);
+    }
+
+    template <typename KeyOf>
+    void dump(KeyOf key_of) const
+    {
+        fprintf(stdout, "\tp       : %zu\n", p_);
+        t1_.dump("T1", links_, key_of);
+        t2_.dump("T2", links_, key_of);
+        b1_.dump("B1");
+        b2_.dump("B2");
+    }
+
+    CACHE_STATS_ONLY(const PolicyCounters& counters() const { return counters_; })
+
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + links_.memory_bytes() + in_t2_.capacity() + b1_.memory_bytes() + b2_.memory_bytes();
+    }
+};
+
+// W-TinyLFU by Einziger, Friedman and Manes: new pages enter a small LRU window (1% of capacity),
+// pages leaving the window are candidates to the main segmented LRU (probation and protected, 80% of
+// main, pages are promoted to protected on a hit), and a candidate replaces the victim of main only if
+// the frequency sketch estimates it as more popular, so one-hit wonders of scans don't flush hot pages;
+// frequency state takes a few bytes per page and is forgotten by periodic halving
+template <typename KeyT>
+class WTinyLFU
+{
+    enum Segment : uint8_t { WINDOW, PROBATION, PROTECTED };
+
+    size_t                 window_cap_;
+    size_t                 protected_cap_;
+    SlotLinks              links_;
+    SlotList               window_;
+    SlotList               probation_;
+    SlotList               protected_;
+    std::vector<uint8_t>   segment_;
+    FrequencySketch<KeyT>  sketch_;
+    CACHE_STATS_ONLY(PolicyCounters counters_;)
+
+    SlotList& list(uint32_t slot) { return (segment_[slot] == WINDOW) ? window_ : (segment_[slot] == PROBATION) ? probation_ : protected_; }
+
+    void move(uint32_t slot, SlotList& to, Segment segment)
+    {
+        list(slot).remove(links_, slot);
+        to.push_back(links_, slot);
+        segment_[slot] = segment;
+    }
+
+public:
+    WTinyLFU(size_t capacity) :
+        window_cap_(std::max<size_t>(capacity / 100, 1)),
+        protected_cap_((capacity - std::min(capacity, window_cap_)) * 8 / 10),
+        links_(capacity),
+        sketch_(capacity) { segment_.reserve(capacity); }
+
+    void on_hit(uint32_t slot, const KeyT& key)
+    {
+        sketch_.increment(key);
+
+        if (segment_[slot] != PROBATION)
+        {
+            move(slot, list(slot), Segment(segment_[slot]));
+            CACHE_STATS_ONLY(counters_.splices++;)
+            return;
+        }
+
+        move(slot, protected_, PROTECTED);
+        CACHE_STATS_ONLY(counters_.promotions++;)
+        if (protected_.size > protected_cap_) move(protected_.head, probation_, PROBATION);
+    }
+
+    void on_miss(const KeyT& key) { sketch_.increment(key); }
+
+    // the new page takes the window, so the LRU page of a full window either gets to main
+    // in place of the victim of main or is evicted itself
+    template <typename KeyOf>
+    uint32_t victim(KeyOf key_of)
+    {
+        uint32_t main_victim = probation_.size ? probation_.head : protected_.head;
+
+        if (main_victim == NO_SLOT) return window_.pop_front(links_);
+        if (window_.size < window_cap_) return list(main_victim).pop_front(links_);
+
+        uint32_t candidate = window_.head;
+
+        if (sketch_.estimate(key_of(candidate)) > sketch_.estimate(key_of(main_victim)))
+        {
+            list(main_victim).remove(links_, main_victim);
+            move(candidate, probation_, PROBATION);
+            return main_victim;
+        }
+
+        return window_.pop_front(links_);
+    }
+
+    // while the cache isn't full, pages leaving the window get to main without competition
+    void on_insert(uint32_t slot, const KeyT&)
+    {
+        links_.fit(slot);
+        if (slot >= segment_.size()) segment_.resize(slot + 1);
+
+        segment_[slot] = WINDOW;
+        window_.push_back(links_, slot);
+
+        if (window_.size > window_cap_) move(window_.head, probation_, PROBATION);
+    }
+
+    void on_erase(uint32_t slot) { list(slot).remove(links_, slot); }
+
+    void on_weight(uint32_t, size_t) {}
+
+    void prefetch(uint32_t slot) const
+    {
+        __builtin_prefetch(&segment_[slot]);
+        links_.prefetch(slot);
+    }
+
+    template <typename KeyOf>
+    void dump(KeyOf key_of) const
+    {
+        window_   .dump("window",    links_, key_of);
+        probation_.dump("probation", links_, key_of);
+        protected_.dump("protected", links_, key_of);
+    }
+
+    CACHE_STATS_ONLY(const PolicyCounters& counters() const { return counters_; })
+
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + links_.memory_bytes() + segment_.capacity() + sketch_.memory_bytes();
+    }
+};
+
+// GreedyDual-Size-Frequency by Cherkasova: priority of a page is L + frequency / weight, the page of the
+// least priority is evicted and L becomes its priority, so pages that aren't requested any more age out as
+// L inflates, and of two pages requested as often the smaller one stays; with all weights 1 it's LFU with
+// dynamic aging. Slots are kept in a binary min-heap by priority, ties go to the least recently used page
+template <typename KeyT>
+class GDSF
+{
+    std::vector<uint32_t> heap_    ;
+    std::vector<uint32_t> position_;    // index of the slot in heap_
+    std::vector<double>   priority_;
+    std::vector<uint64_t> last_use_;
+    std::vector<uint32_t> freq_    ;
+    std::vector<size_t>   weight_  ;
+    double                inflation_ = 0;  // L, priority of the last victim
+    uint64_t              clock_     = 0;
+    CACHE_STATS_ONLY(PolicyCounters counters_;)
+
+    bool less(uint32_t a, uint32_t b) const
+    {
+        return (priority_[a] != priority_[b]) ? (priority_[a] < priority_[b]) : (last_use_[a] < last_use_[b]);
+    }
+
+    void place(size_t i, uint32_t slot)
+    {
+        heap_[i] = slot;
+        position_[slot] = i;
+    }
+
+    void sift_up(size_t i)
+    {
+        uint32_t slot = heap_[i];
+
+        for (; i > 0 && less(slot, heap_[(i - 1) / 2]); i = (i - 1) / 2) place(i, heap_[(i - 1) / 2]);
+        place(i, slot);
+    }
+
+    void sift_down(size_t i)
+    {
+        uint32_t slot = heap_[i];
+
+        for (size_t child = 2 * i + 1; child < heap_.size(); i = child, child = 2 * i + 1)
+        {
+            if (child + 1 < heap_.size() && less(heap_[child + 1], heap_[child])) child++;
+            if (!less(heap_[child], slot)) break;
+
+            place(i, heap_[child]);
+        }
+
+        place(i, slot);
+    }
+
+    void remove(uint32_t slot)
+    {
+        size_t   i    = position_[slot];
+        uint32_t last = heap_.back();
+
+        heap_.pop_back();
+        if (last == slot) return;
+
+        place(i, last);
+        sift_up(i);
+        sift_down(position_[last]);
+    }
+
+    void rank(uint32_t slot) { priority_[slot] = inflation_ + double(freq_[slot]) / double(weight_[slot]); }
+
+public:
+    GDSF(size_t capacity)
+    {
+        heap_    .reserve(capacity);
+        position_.reserve(capacity);
+        priority_.reserve(capacity);
+        last_use_.reserve(capacity);
+        freq_    .reserve(capacity);
+        weight_  .reserve(capacity);
+    }
+
+    // priority only grows, so the page sinks
+    void on_hit(uint32_t slot, const KeyT&)
+    {
+        if (freq_[slot] != UINT32_MAX) freq_[slot]++;
+        last_use_[slot] = clock_++;
+        rank(slot);
+        sift_down(position_[slot]);
+        CACHE_STATS_ONLY(counters_.promotions++;)
+    }
+
+    void on_miss(const KeyT&) {}
+
+    template <typename KeyOf>
+    uint32_t victim(KeyOf)
+    {
+        uint32_t slot = heap_[0];
+        inflation_ = priority_[slot];
+        remove(slot);
+        return slot;
+    }
+
+    void on_insert(uint32_t slot, const KeyT&)
+    {
+        if (slot >= position_.size())
+        {
+            position_.resize(slot + 1);
+            priority_.resize(slot + 1);
+            last_use_.resize(slot + 1);
+            freq_    .resize(slot + 1);
+            weight_  .resize(slot + 1);
+        }
+
+        freq_    [slot] = 1;
+        weight_  [slot] = 1;
+        last_use_[slot] = clock_++;
+        rank(slot);
+
+        heap_.push_back(slot);
+        position_[slot] = heap_.size() - 1;
+        sift_up(heap_.size() - 1);
+    }
+
+    void on_erase(uint32_t slot) { remove(slot); }
+
+    void on_weight(uint32_t slot, size_t weight)
+    {
+        weight_[slot] = std::max<size_t>(weight, 1);
+        rank(slot);
+        sift_up(position_[slot]);
+        sift_down(position_[slot]);
+    }
+
+    void prefetch(uint32_t slot) const
+    {
+        __builtin_prefetch(&position_[slot]);
+        __builtin_prefetch(&priority_[slot]);
+    }
+
+    // pages in the order of the heap
+    template <typename KeyOf>
+    void dump(KeyOf key_of) const
+    {
+        fprintf(stdout, "\tL       : %g\n\tGDSF    :", inflation_);
+        for (uint32_t slot : heap_) { std::cout << " " << key_of(slot) << "(" << priority_[slot] << ")"; }
+        std::cout << "\n";
+    }
+
+    CACHE_STATS_ONLY(const PolicyCounters& counters() const { return counters_; })
+
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + (heap_.capacity() + position_.capacity() + freq_.capacity()) * sizeof(uint32_t) +
+               priority_.capacity() * sizeof(double) + last_use_.capacity() * sizeof(uint64_t) +
+               weight_.capacity() * sizeof(size_t);
+    }
+};
+
+// policy of dispatch_policy(), Policy is the policy template and label is its name in reports padded to one width
+template <template <typename> class PolicyT>
+struct PolicyTag
+{
+    template <typename KeyT>
+    using Policy = PolicyT<KeyT>;
+
+    const char* label;
+};
+
+// calls f(PolicyTag<P>{label}) for the policy P with the name of cache driver: lfu, lru, 2q, arc, tinylfu or gdsf;
+// returns false if there is no such policy
+template <typename F>
+bool dispatch_policy(const std::string& name, F f)
+{
+    if      (name == "lfu")     f(PolicyTag<LFU>     {"LFU    "});
+    else if (name == "lru")     f(PolicyTag<LRU>     {"LRU    "});
+    else if (name == "2q")      f(PolicyTag<TwoQ>    {"2Q     "});
+    else if (name == "arc")     f(PolicyTag<ARC>     {"ARC    "});
+    else if (name == "tinylfu") f(PolicyTag<WTinyLFU>{"TinyLFU"});
+    else if (name == "gdsf")    f(PolicyTag<GDSF>    {"GDSF   "});
+    else return false;
+
+    return true;
+}
+
+#endif
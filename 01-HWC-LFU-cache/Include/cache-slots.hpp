@@ -0,0 +1,115 @@
+#ifndef CACHE_SLOTS_HPP
+#define CACHE_SLOTS_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "cache-index.hpp"
+#include "cache-policy.hpp"
+
+// pages of a cache kept as structure of arrays indexed by 32-bit slots, shared by Cache_t, WeightedCache
+// and ExpiringCache: the arrays are reserved at once for max_pages and never move, slots of erased pages
+// are reused first; hash_t_ maps keys to slots and policy_ orders slots for eviction, while the cache
+// decides when a page is evicted
+template <typename T, typename KeyT, template <typename> class PolicyT, typename IndexT>
+struct CacheSlots
+{
+    static constexpr uint32_t NIL = NO_SLOT;
+
+    std::vector<KeyT>     keys_      ;
+    std::vector<T>        values_    ;
+    std::vector<uint32_t> free_slots_;  // slots of erased pages
+    PolicyT<KeyT>         policy_    ;
+    IndexT                hash_t_    ;
+
+    // policy_args are passed to the policy constructor after max_pages
+    template <typename... Args>
+    CacheSlots(size_t max_pages, Args&&... policy_args) :
+        policy_(max_pages, std::forward<Args>(policy_args)...),
+        hash_t_(max_pages)
+    {
+        assert(max_pages < NIL);
+
+        keys_  .reserve(max_pages);
+        values_.reserve(max_pages);
+    }
+
+    auto key_of() const { return [this](uint32_t slot) -> const KeyT& { return keys_[slot]; }; }
+
+    // the page goes to a free slot or to a new one, the cache has made room for it
+    uint32_t add_page(const KeyT& key, T&& value)
+    {
+        uint32_t slot = 0;
+
+        if (!free_slots_.empty())
+        {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+
+            keys_  [slot] = key;
+            values_[slot] = std::move(value);
+        }
+        else
+        {
+            slot = keys_.size();
+            keys_  .push_back(key);
+            values_.push_back(std::move(value));
+        }
+
+        hash_t_.insert(key, slot, key_of());
+        policy_.on_insert(slot, key);
+        return slot;
+    }
+
+    // the page takes the slot of the victim of the policy, so nothing is allocated;
+    // the victim is passed to evicted(key, value) right before its slot is reused
+    template <typename F>
+    uint32_t reuse_victim(const KeyT& key, T&& value, F& evicted)
+    {
+        uint32_t slot = policy_.victim(key_of());
+
+        evicted(keys_[slot], values_[slot]);
+        hash_t_.replace(keys_[slot], key, slot, key_of());
+
+        keys_  [slot] = key;
+        values_[slot] = std::move(value);
+
+        policy_.on_insert(slot, key);
+        return slot;
+    }
+
+    // frees the slot of the victim of the policy and returns it
+    uint32_t evict_victim()
+    {
+        uint32_t slot = policy_.victim(key_of());
+
+        free_slot(slot);
+        return slot;
+    }
+
+    // takes the page out of the policy and frees its slot
+    void erase_slot(uint32_t slot)
+    {
+        policy_.on_erase(slot);
+        free_slot(slot);
+    }
+
+    // bytes taken by free slots, the policy and the index
+    size_t slots_bytes() const
+    {
+        return free_slots_.capacity() * sizeof(uint32_t) + policy_.memory_bytes() + hash_t_.memory_bytes();
+    }
+
+private:
+    // the policy has let the slot go already
+    void free_slot(uint32_t slot)
+    {
+        hash_t_.erase(keys_[slot], key_of());
+
+        values_[slot] = T();    // release resources of the value right away
+        free_slots_.push_back(slot);
+    }
+};
+
+#endif
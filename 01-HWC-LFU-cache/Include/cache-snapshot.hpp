@@ -0,0 +1,164 @@
+#ifndef CACHE_SNAPSHOT_HPP
+#define CACHE_SNAPSHOT_HPP
+
+#include <system_error>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Binary snapshot of Cache_t, see Cache_t::save() and load(). The file is the header followed by
+// three arrays of count entries, each padded to 8 bytes: keys, ranks of the policy and values, all
+// in the order of eviction, so a policy rebuilds itself by appending pages in the same order.
+// Numbers are in the byte order of the machine, a snapshot isn't meant to travel between machines.
+
+struct SnapshotHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t policy;        // SNAPSHOT_ID of the policy
+    uint32_t key_size;
+    uint32_t value_size;
+    uint64_t count;
+};
+
+constexpr char     SNAPSHOT_MAGIC[8] = { 'C', 'A', 'C', 'H', 'E', 'S', 'N', 'P' };
+constexpr uint32_t SNAPSHOT_VERSION  = 1;
+
+inline size_t snapshot_padded(size_t size) { return (size + 7) & ~size_t(7); }
+
+// file written next to path and renamed over it on commit(), so a crash never leaves half a snapshot
+class SnapshotWriter
+{
+    std::string path_;
+    std::string temp_;
+    int         fd_ = -1;
+
+    void write_all(const void* data, size_t size)
+    {
+        for (size_t done = 0; done < size;)
+        {
+            ssize_t n = ::write(fd_, static_cast<const char*>(data) + done, size - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) throw std::system_error(errno, std::generic_category(), "can't write " + temp_);
+            done += n;
+        }
+    }
+
+public:
+    explicit SnapshotWriter(const char* path) : path_(path), temp_(std::string(path) + ".tmp")
+    {
+        fd_ = open(temp_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "can't create " + temp_);
+    }
+
+    SnapshotWriter(const SnapshotWriter&)            = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    ~SnapshotWriter()
+    {
+        if (fd_ < 0) return;
+
+        close(fd_);
+        unlink(temp_.c_str());
+    }
+
+    // writes the data followed by zeros up to 8 bytes
+    void write(const void* data, size_t size)
+    {
+        static const char zeros[8] = {};
+
+        write_all(data, size);
+        write_all(zeros, snapshot_padded(size) - size);
+    }
+
+    void commit()
+    {
+        if (fsync(fd_) < 0) throw std::system_error(errno, std::generic_category(), "can't sync " + temp_);
+
+        close(fd_);
+        fd_ = -1;
+
+        if (rename(temp_.c_str(), path_.c_str()) < 0)
+        {
+            int error = errno;
+            unlink(temp_.c_str());
+            throw std::system_error(error, std::generic_category(), "can't rename " + temp_ + " to " + path_);
+        }
+    }
+};
+
+// snapshot mapped to memory, the header is checked against the cache that reads it
+class SnapshotMap
+{
+    char*  map_  = nullptr;
+    size_t size_ = 0;
+
+public:
+    explicit SnapshotMap(const char* path)
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), std::string("can't open ") + path);
+
+        struct stat st = {};
+        if (fstat(fd, &st) < 0)
+        {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), std::string("can't stat ") + path);
+        }
+
+        size_ = st.st_size;
+
+        if (size_ < sizeof(SnapshotHeader))
+        {
+            close(fd);
+            throw std::runtime_error(std::string("not a cache snapshot: ") + path);
+        }
+
+        void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        int error = errno;
+        close(fd);
+
+        if (map == MAP_FAILED) throw std::system_error(error, std::generic_category(), std::string("can't map ") + path);
+
+        map_ = static_cast<char*>(map);
+    }
+
+    SnapshotMap(const SnapshotMap&)            = delete;
+    SnapshotMap& operator=(const SnapshotMap&) = delete;
+
+    ~SnapshotMap() { munmap(map_, size_); }
+
+    const SnapshotHeader& header() const { return *reinterpret_cast<const SnapshotHeader*>(map_); }
+
+    // throws std::runtime_error unless the snapshot is of the same version, policy and types
+    void check(uint32_t policy, size_t key_size, size_t value_size) const
+    {
+        const SnapshotHeader& h = header();
+
+        if (memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)))
+            throw std::runtime_error("not a cache snapshot");
+        if (h.version != SNAPSHOT_VERSION)
+            throw std::runtime_error("snapshot version " + std::to_string(h.version) + " isn't supported");
+        if (h.policy != policy || h.key_size != key_size || h.value_size != value_size)
+            throw std::runtime_error("snapshot is of another policy, key or value type");
+
+        size_t expected = sizeof(SnapshotHeader) + snapshot_padded(h.count * key_size) +
+                          snapshot_padded(h.count * sizeof(uint32_t)) + snapshot_padded(h.count * value_size);
+
+        if (h.count > size_ || size_ != expected) throw std::runtime_error("snapshot is truncated");
+    }
+
+    const char* keys()   const { return map_ + sizeof(SnapshotHeader); }
+    const char* ranks()  const { return keys()  + snapshot_padded(header().count * header().key_size); }
+    const char* values() const { return ranks() + snapshot_padded(header().count * sizeof(uint32_t)); }
+};
+
+#endif
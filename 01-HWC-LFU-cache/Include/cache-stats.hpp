@@ -0,0 +1,186 @@
+#ifndef CACHE_STATS_HPP
+#define CACHE_STATS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <string>
+
+// Instrumentation of Cache_t and its policies, compiled in only if CACHE_STATS is defined
+// (cmake -DCACHE_STATS=ON): without it CACHE_STATS_ONLY() expands to nothing, so neither members
+// nor code of statistics are left in the cache. The classes themselves may be used in any build.
+#ifdef CACHE_STATS
+#define CACHE_STATS_ONLY(...) __VA_ARGS__
+#else
+#define CACHE_STATS_ONLY(...)
+#endif
+
+// events inside a policy:
+//     promotions   - hits that moved a page to a more valuable list (T1 to T2, probation to protected)
+//                    or raised its GDSF priority
+//     splices      - pages relinked to the recent end of their list by a hit, buckets spliced by LFU aging
+//     bucket_moves - pages moved to the bucket of the next frequency by LFU
+struct PolicyCounters
+{
+    uint64_t promotions   = 0;
+    uint64_t splices      = 0;
+    uint64_t bucket_moves = 0;
+};
+
+// HDR-style histogram of latencies in nanoseconds: values below 2^SUB_BITS have their own buckets,
+// every greater power of two is split into 2^SUB_BITS buckets, so any value is known up to 1 / 2^SUB_BITS
+// of it in a fixed array whatever the range; recording is a few instructions and never allocates
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned SUB_BITS = 4;
+    static constexpr unsigned SUB      = 1u << SUB_BITS;
+    static constexpr unsigned BUCKETS  = (64 - SUB_BITS + 1) * SUB;
+
+private:
+    uint64_t counts_[BUCKETS] = {};
+    uint64_t count_ = 0;
+    uint64_t sum_   = 0;
+    uint64_t min_   = UINT64_MAX;
+    uint64_t max_   = 0;
+
+public:
+    static unsigned bucket(uint64_t value)
+    {
+        if (value < SUB) return value;
+
+        unsigned shift = 63 - __builtin_clzll(value) - SUB_BITS;
+        return (shift + 1) * SUB + ((value >> shift) - SUB);
+    }
+
+    // the least value of the bucket
+    static uint64_t lower_bound(unsigned bucket)
+    {
+        if (bucket < SUB) return bucket;
+
+        unsigned shift = bucket / SUB - 1;
+        return uint64_t(SUB + bucket % SUB) << shift;
+    }
+
+    // the greatest value of the bucket
+    static uint64_t upper_bound(unsigned bucket)
+    {
+        return (bucket + 1 < BUCKETS) ? lower_bound(bucket + 1) - 1 : UINT64_MAX;
+    }
+
+    void record(uint64_t value)
+    {
+        counts_[bucket(value)]++;
+        count_++;
+        sum_ += value;
+        if (value < min_) min_ = value;
+        if (value > max_) max_ = value;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t min()   const { return count_ ? min_ : 0; }
+    uint64_t max()   const { return max_; }
+    double   mean()  const { return count_ ? double(sum_) / count_ : 0; }
+
+    // the value not less than the fraction q of recorded values, up to the width of its bucket
+    uint64_t percentile(double q) const
+    {
+        if (count_ == 0) return 0;
+
+        uint64_t rank = q * count_;
+        if (rank >= count_) rank = count_ - 1;
+
+        uint64_t seen = 0;
+        for (unsigned i = 0; i < BUCKETS; i++)
+        {
+            seen += counts_[i];
+            if (seen > rank) return std::min(upper_bound(i), max_);
+        }
+
+        return max_;
+    }
+
+    // summary and non-empty buckets as [lower bound, count]
+    std::string to_json() const
+    {
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer),
+                 "{\"count\": %llu, \"min\": %llu, \"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, "
+                 "\"p999\": %llu, \"max\": %llu, \"buckets\": [",
+                 (unsigned long long)count_, (unsigned long long)min(), mean(),
+                 (unsigned long long)percentile(0.5),  (unsigned long long)percentile(0.9),
+                 (unsigned long long)percentile(0.99), (unsigned long long)percentile(0.999), (unsigned long long)max_);
+
+        std::string json = buffer;
+        const char* separator = "";
+
+        for (unsigned i = 0; i < BUCKETS; i++)
+        {
+            if (!counts_[i]) continue;
+
+            snprintf(buffer, sizeof(buffer), "%s[%llu, %llu]", separator,
+                     (unsigned long long)lower_bound(i), (unsigned long long)counts_[i]);
+            json += buffer;
+            separator = ", ";
+        }
+
+        return json + "]}";
+    }
+};
+
+// counters and latencies of operations of Cache_t; latency of get() includes the loader
+struct CacheStats
+{
+    uint64_t       hits       = 0;
+    uint64_t       misses     = 0;
+    uint64_t       insertions = 0;
+    uint64_t       evictions  = 0;
+    uint64_t       erasures   = 0;
+    PolicyCounters policy;
+
+    LatencyHistogram update_ns;
+    LatencyHistogram find_ns;
+    LatencyHistogram get_ns;
+    LatencyHistogram put_ns;
+    LatencyHistogram erase_ns;
+
+    double hit_ratio() const { return (hits + misses) ? double(hits) / (hits + misses) : 0; }
+
+    std::string to_json() const
+    {
+        char buffer[512];
+        snprintf(buffer, sizeof(buffer),
+                 "{\"hits\": %llu, \"misses\": %llu, \"hit_ratio\": %.6f, \"insertions\": %llu, \"evictions\": %llu, "
+                 "\"erasures\": %llu, \"promotions\": %llu, \"splices\": %llu, \"bucket_moves\": %llu, \"latency_ns\": {",
+                 (unsigned long long)hits, (unsigned long long)misses, hit_ratio(), (unsigned long long)insertions,
+                 (unsigned long long)evictions, (unsigned long long)erasures, (unsigned long long)policy.promotions,
+                 (unsigned long long)policy.splices, (unsigned long long)policy.bucket_moves);
+
+        return std::string(buffer) +
+               "\"update\": " + update_ns.to_json() + ", \"find\": " + find_ns .to_json() + ", " +
+               "\"get\": "    + get_ns   .to_json() + ", \"put\": "  + put_ns  .to_json() + ", " +
+               "\"erase\": "  + erase_ns .to_json() + "}}";
+    }
+};
+
+// records the time from construction to destruction
+class ScopedLatency
+{
+    LatencyHistogram&                     histogram_;
+    std::chrono::steady_clock::time_point start_;
+
+public:
+    explicit ScopedLatency(LatencyHistogram& histogram) : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+
+    ScopedLatency(const ScopedLatency&)            = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+    ~ScopedLatency()
+    {
+        auto time = std::chrono::steady_clock::now() - start_;
+        histogram_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+    }
+};
+
+#endif
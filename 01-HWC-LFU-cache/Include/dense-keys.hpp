@@ -0,0 +1,40 @@
+#ifndef DENSE_KEYS_HPP
+#define DENSE_KEYS_HPP
+
+#include <unordered_map>
+#include <cstdint>
+#include <vector>
+
+// trace whose keys are renamed to dense ids 0 ... U-1 in the order of their first requests;
+// the id of a request is the key of its page for DenseIndex and dense_perfect_cache_hits(),
+// which replace hashing of keys by arrays indexed by id, and keys[id] is the original key
+template <typename KeyT = int>
+struct DenseTrace
+{
+    std::vector<uint32_t> ids;
+    std::vector<KeyT>     keys;
+
+    size_t universe() const { return keys.size(); }
+};
+
+// one pass over the trace, the only one that hashes keys
+template <typename KeyT>
+DenseTrace<KeyT> remap_dense(const std::vector<KeyT>& page_keys)
+{
+    DenseTrace<KeyT> trace;
+    std::unordered_map<KeyT, uint32_t> id_of;
+
+    trace.ids.reserve(page_keys.size());
+
+    for (const KeyT& key : page_keys)
+    {
+        auto it = id_of.emplace(key, trace.keys.size()).first;
+        if (it->second == trace.keys.size()) trace.keys.push_back(key);
+
+        trace.ids.push_back(it->second);
+    }
+
+    return trace;
+}
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef EXPIRING_CACHE_HPP
+#define EXPIRING_CACHE_HPP
+
+#include <iostream>
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include <chrono>
+#include <vector>
+#include "cache-slots.hpp"
+#include "timer-wheel.hpp"
+
+// milliseconds of std::chrono::steady_clock, the default clock of ExpiringCache
+struct SteadyClock
+{
+    uint64_t now() const
+    {
+        auto time = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time).count();
+    }
+};
+
+// cache whose pages expire after their time to live: pages are kept in CacheSlots, and a page is scheduled
+// in a hierarchical timer wheel over the same slots at insertion, and every operation first moves the wheel
+// to the time of ClockT, so expired pages free their slots lazily in O(1) each, before the policy is asked
+// for a victim. get() moves the wheel once more after the loader returns, as the clock may go on meanwhile;
+// ttl counts ticks of ClockT::now() (milliseconds by default) and is set by insertion and put(),
+// hits don't extend it, and pages put with FOREVER never expire; a page whose deadline has come by the time
+// it would be cached (ttl is 0, or the clock has passed the deadline while the value was loaded) expires
+// at once: it isn't cached and doesn't evict anything
+template <typename T, typename KeyT = int, template <typename> class PolicyT = LFU,
+          typename ClockT = SteadyClock, typename IndexT = FlatIndex<KeyT>>
+class ExpiringCache : CacheSlots<T, KeyT, PolicyT, IndexT>
+{
+    using Slots = CacheSlots<T, KeyT, PolicyT, IndexT>;
+    using Slots::NIL;
+    using Slots::values_;
+    using Slots::policy_;
+    using Slots::hash_t_;
+    using Slots::key_of;
+
+public:
+    static constexpr uint64_t FOREVER = UINT64_MAX;
+
+private:
+    size_t                size_      ;
+    ClockT                clock_     ;
+    TimerWheel            wheel_     ;
+    size_t                expired_ = 0;
+    T                     uncached_  ;  // value returned by get() if the page isn't cached
+
+    // deadline of ttl ticks from now, saturated
+    uint64_t deadline(uint64_t ttl) const { return (ttl < FOREVER - wheel_.now()) ? wheel_.now() + ttl : FOREVER; }
+
+    // counts the page as expired and returns true if its deadline has come already,
+    // the wheel would refuse to schedule such a page
+    bool expire_at_once(uint64_t due)
+    {
+        if (due == FOREVER || due > std::max(wheel_.now(), clock_.now())) return false;
+
+        expired_++;
+        return true;
+    }
+
+    // the page must not expire at once
+    void schedule(uint32_t slot, uint64_t due)
+    {
+        wheel_.cancel(slot);
+        if (due == FOREVER) return;
+
+        bool scheduled = wheel_.schedule(slot, due);
+        assert(scheduled);
+        (void)scheduled;
+    }
+
+    // the timer of a reused victim is cancelled by schedule()
+    uint32_t insert(const KeyT& key, T&& value, uint64_t due)
+    {
+        auto ignore = [](const KeyT&, T&) {};
+
+        policy_.on_miss(key);
+
+        uint32_t slot = (hash_t_.size() == size_) ? this->reuse_victim(key, std::move(value), ignore) :
+                                                    this->add_page(key, std::move(value));
+        schedule(slot, due);
+        return slot;
+    }
+
+public:
+    // policy_args are passed to the policy constructor after the capacity
+    template <typename... Args>
+    ExpiringCache(size_t size, ClockT clock = ClockT(), Args&&... policy_args) :
+        Slots(size, std::forward<Args>(policy_args)...),
+        size_(size),
+        clock_(clock),
+        wheel_(size, clock_.now()) {}
+
+    size_t size() const { return hash_t_.size(); }
+
+    // number of pages expired so far
+    size_t expired() const { return expired_; }
+
+    // frees slots of all pages whose time has come, called by every operation
+    void expire()
+    {
+        wheel_.advance(clock_.now(), [this](uint32_t slot)
+        {
+            this->erase_slot(slot);
+            expired_++;
+        });
+    }
+
+    bool update(const KeyT& key, uint64_t ttl = FOREVER)
+    {
+        if (find(key)) return true;
+
+        uint64_t due = deadline(ttl);
+        if (size_ != 0 && !expire_at_once(due)) insert(key, T(), due);
+        return false;
+    }
+
+    // returns cached value of the page or nullptr without counting the page as requested,
+    // an expired page that isn't freed yet is not found
+    const T* peek(const KeyT& key) const
+    {
+        uint32_t hit = hash_t_.find(key, key_of());
+        if (hit == NIL || (wheel_.scheduled(hit) && wheel_.deadline(hit) <= clock_.now())) return nullptr;
+
+        return &values_[hit];
+    }
+
+    // returns cached value of the page or nullptr, a found page counts as requested
+    T* find(const KeyT& key)
+    {
+        expire();
+
+        uint32_t hit = hash_t_.find(key, key_of());
+        if (hit == NIL) return nullptr;
+
+        policy_.on_hit(hit, key);
+        return &values_[hit];
+    }
+
+    // returns cached value of the page, calls loader(key) to get it in case of a miss;
+    // the reference stays valid until the page expires, is evicted or erased
+    template <typename F>
+    T& get(const KeyT& key, F loader, uint64_t ttl = FOREVER)
+    {
+        T* value = find(key);
+        if (value) return *value;
+
+        if (size_ == 0) return uncached_ = loader(key);
+
+        // ttl counts from the request, and the clock may pass deadlines of cached pages and of the loaded one
+        // while the value is loaded, so expired pages are freed again before a victim is chosen
+        uint64_t due    = deadline(ttl);
+        T        loaded = loader(key);
+
+        expire();
+        if (expire_at_once(due)) return uncached_ = std::move(loaded);
+
+        return values_[insert(key, std::move(loaded), due)];
+    }
+
+    // puts value to cache replacing the old one and its time to live, returns true if the page was there
+    bool put(const KeyT& key, T value, uint64_t ttl = FOREVER)
+    {
+        expire();
+
+        uint32_t slot = hash_t_.find(key, key_of());
+        uint64_t due  = deadline(ttl);
+
+        if (slot != NIL)
+        {
+            if (expire_at_once(due))
+            {
+                wheel_.cancel(slot);
+                this->erase_slot(slot);
+                return true;
+            }
+
+            policy_.on_hit(slot, key);
+            values_[slot] = std::move(value);
+            schedule(slot, due);
+            return true;
+        }
+
+        if (size_ != 0 && !expire_at_once(due)) insert(key, std::move(value), due);
+        return false;
+    }
+
+    // removes page from cache, returns false if there was no such page
+    bool erase(const KeyT& key)
+    {
+        expire();
+
+        uint32_t slot = hash_t_.find(key, key_of());
+        if (slot == NIL) return false;
+
+        wheel_.cancel(slot);
+        this->erase_slot(slot);
+        return true;
+    }
+
+    void dump() const
+    {
+        std::cout << "ExpiringCache dump at " << wheel_.now() << ": \n{\n";
+        policy_.dump(key_of());
+        std::cout << "}\n\n";
+    }
+
+    // bytes taken by the cache besides keys and values
+    size_t metadata_bytes() const
+    {
+        return sizeof(*this) + this->slots_bytes() + wheel_.memory_bytes();
+    }
+};
+
+#endif
@@ -0,0 +1,352 @@
+#ifndef EXTERNAL_PERFECT_CACHE_HPP
+#define EXTERNAL_PERFECT_CACHE_HPP
+
+#include <system_error>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <set>
+
+#include <unistd.h>
+
+// temporary file that is removed as soon as it's created, so it disappears with the descriptor
+class TempFile
+{
+    int fd_ = -1;
+
+public:
+    explicit TempFile(const char* dir)
+    {
+        std::string path = std::string(dir) + "/perfect-cache-XXXXXX";
+
+        fd_ = mkstemp(&path[0]);
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "can't create temporary file in " + std::string(dir));
+
+        unlink(path.c_str());
+    }
+
+    TempFile(const TempFile&)            = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+    ~TempFile() { close(fd_); }
+
+    void write(const void* data, size_t size, size_t offset)
+    {
+        for (size_t done = 0; done < size;)
+        {
+            ssize_t n = pwrite(fd_, static_cast<const char*>(data) + done, size - done, offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) throw std::system_error(errno, std::generic_category(), "can't write temporary file");
+            done += n;
+        }
+    }
+
+    void read(void* data, size_t size, size_t offset) const
+    {
+        for (size_t done = 0; done < size;)
+        {
+            ssize_t n = pread(fd_, static_cast<char*>(data) + done, size - done, offset + done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) throw std::system_error(errno, std::generic_category(), "can't read temporary file");
+            if (n == 0) throw std::system_error(EIO, std::generic_category(), "temporary file is truncated");
+            done += n;
+        }
+    }
+};
+
+// Belady's OPT for traces that don't fit in memory: keys are pushed in chunks and stored in a binary
+// temporary file, next uses of all requests are found by an external sort of the requests by key and
+// written to another temporary file, and a forward pass over next uses evicts the resident page requested
+// the latest; memory takes a few chunks of the trace and the next uses of resident pages, but nothing
+// proportional to the length of the trace or to the number of distinct keys, as sorted runs are merged
+// by passes of a bounded fan-in; keys have to be ordered by operator<, the files are in $TMPDIR or /tmp
+template <typename KeyT = int>
+class ExternalPerfectCache
+{
+    struct Use      // request of the key at the position
+    {
+        KeyT     key;
+        uint64_t pos;
+
+        bool operator<(const Use& other) const
+        {
+            return (key < other.key) || (!(other.key < key) && pos < other.pos);
+        }
+    };
+
+    struct Next     // the position of the next request of the key requested at pos
+    {
+        uint64_t pos;
+        uint64_t next;
+
+        bool operator<(const Next& other) const { return pos < other.pos; }
+    };
+
+    static constexpr size_t MIN_BUFFER = 256;   // records of a run read at once, unless chunks are smaller
+
+    size_t            chunk_;
+    TempFile          keys_file_;
+    TempFile          next_file_;   // next_use[i] is the position of the next request of the i-th key
+    std::vector<KeyT> keys_;        // keys pushed since the last flush
+    size_t            n_page_    = 0;
+    bool              next_done_ = false;
+
+    static const char* temp_dir()
+    {
+        const char* dir = getenv("TMPDIR");
+        return (dir && *dir) ? dir : "/tmp";
+    }
+
+    void flush()
+    {
+        keys_file_.write(keys_.data(), keys_.size() * sizeof(KeyT), (n_page_ - keys_.size()) * sizeof(KeyT));
+        keys_.clear();
+    }
+
+    // merges sorted runs of run_size records that cover records [begin, end) of the file and passes
+    // the records to sink in order; every run is read through a buffer of chunk_ / runs records
+    template <typename RecordT, typename F>
+    void merge_group(const TempFile& runs, size_t begin, size_t end, size_t run_size, F sink) const
+    {
+        struct Run
+        {
+            size_t               begin, end;    // records of the run that aren't buffered yet
+            std::vector<RecordT> buffer;
+            size_t               pos;           // the least record of the run is buffer[pos]
+        };
+
+        size_t n_runs      = (end - begin + run_size - 1) / run_size;
+        size_t buffer_size = std::max<size_t>(chunk_ / std::max<size_t>(n_runs, 1), 1);
+
+        std::vector<Run> run(n_runs);
+
+        auto load = [&](Run& r)
+        {
+            size_t size = std::min(buffer_size, r.end - r.begin);
+
+            r.buffer.resize(size);
+            runs.read(r.buffer.data(), size * sizeof(RecordT), r.begin * sizeof(RecordT));
+
+            r.begin += size;
+            r.pos    = 0;
+        };
+
+        // heap of runs with the least record on top
+        auto later = [&run](size_t a, size_t b) { return run[b].buffer[run[b].pos] < run[a].buffer[run[a].pos]; };
+
+        std::vector<size_t> heap(n_runs);
+        for (size_t k = 0; k < n_runs; k++)
+        {
+            run[k].begin = begin + k * run_size;
+            run[k].end   = std::min(end, run[k].begin + run_size);
+            load(run[k]);
+
+            heap[k] = k;
+        }
+
+        std::make_heap(heap.begin(), heap.end(), later);
+
+        while (!heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            Run& least = run[heap.back()];
+
+            sink(least.buffer[least.pos++]);
+
+            if (least.pos == least.buffer.size())
+            {
+                if (least.begin == least.end)
+                {
+                    heap.pop_back();
+                    continue;
+                }
+
+                load(least);
+            }
+
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+    }
+
+    // the file holds n records sorted by runs of chunk_ records, passes all records to sink in order;
+    // a pass merges at most fan_in() runs at once into a longer one, so that every run is read by
+    // MIN_BUFFER records at least, and passes go on between the file and a spare one until the last
+    // pass merges few enough runs to feed sink
+    template <typename RecordT, typename F>
+    void merge_runs(TempFile& runs, size_t n, F sink) const
+    {
+        size_t   fan_in   = std::max<size_t>(chunk_ / MIN_BUFFER, 2);
+        size_t   run_size = chunk_;
+        TempFile spare(temp_dir());
+
+        TempFile* from = &runs;
+        TempFile* to   = &spare;
+
+        std::vector<RecordT> merged;
+        merged.reserve(chunk_);
+
+        for (; (n + run_size - 1) / run_size > fan_in; run_size *= fan_in)
+        {
+            size_t written = 0;
+            auto   write   = [&]()
+            {
+                to->write(merged.data(), merged.size() * sizeof(RecordT), written * sizeof(RecordT));
+
+                written += merged.size();
+                merged.clear();
+            };
+
+            auto append = [&](const RecordT& record)
+            {
+                merged.push_back(record);
+                if (merged.size() == chunk_) write();
+            };
+
+            for (size_t begin = 0; begin < n; begin += run_size * fan_in)
+                merge_group<RecordT>(*from, begin, std::min(n, begin + run_size * fan_in), run_size, append);
+
+            write();
+            std::swap(from, to);
+        }
+
+        merge_group<RecordT>(*from, 0, n, run_size, sink);
+    }
+
+    // requests sorted by key and position give next uses key by key, they are sorted back by position;
+    // pages that never occur later get unique next uses past any position
+    void write_next_uses()
+    {
+        TempFile use_runs(temp_dir()), next_runs(temp_dir());
+
+        std::vector<KeyT> keys(chunk_);
+        std::vector<Use>  uses(chunk_);
+
+        for (size_t begin = 0; begin < n_page_; begin += chunk_)
+        {
+            size_t size = std::min(chunk_, n_page_ - begin);
+            keys_file_.read(keys.data(), size * sizeof(KeyT), begin * sizeof(KeyT));
+
+            for (size_t i = 0; i < size; i++) uses[i] = {keys[i], begin + i};
+
+            std::sort(uses.begin(), uses.begin() + size);
+            use_runs.write(uses.data(), size * sizeof(Use), begin * sizeof(Use));
+        }
+
+        std::vector<Next> nexts;
+        nexts.reserve(chunk_);
+
+        size_t n_next = 0;
+        auto emit = [&](const Next& next)
+        {
+            nexts.push_back(next);
+            if (nexts.size() < chunk_) return;
+
+            std::sort(nexts.begin(), nexts.end());
+            next_runs.write(nexts.data(), nexts.size() * sizeof(Next), n_next * sizeof(Next));
+
+            n_next += nexts.size();
+            nexts.clear();
+        };
+
+        bool first = true;
+        Use  last  = {};
+
+        merge_runs<Use>(use_runs, n_page_, [&](const Use& use)
+        {
+            if (!first) emit({last.pos, (last.key < use.key) ? UINT64_MAX - last.pos : use.pos});
+
+            first = false;
+            last  = use;
+        });
+
+        if (!first) emit({last.pos, UINT64_MAX - last.pos});
+
+        std::sort(nexts.begin(), nexts.end());
+        next_runs.write(nexts.data(), nexts.size() * sizeof(Next), n_next * sizeof(Next));
+
+        std::vector<uint64_t> next_use;
+        next_use.reserve(chunk_);
+
+        size_t written = 0;
+        merge_runs<Next>(next_runs, n_page_, [&](const Next& next)
+        {
+            next_use.push_back(next.next);
+            if (next_use.size() < chunk_) return;
+
+            next_file_.write(next_use.data(), next_use.size() * sizeof(uint64_t), written * sizeof(uint64_t));
+
+            written += next_use.size();
+            next_use.clear();
+        });
+
+        next_file_.write(next_use.data(), next_use.size() * sizeof(uint64_t), written * sizeof(uint64_t));
+        next_done_ = true;
+    }
+
+public:
+    // chunk is the number of keys read or written at once
+    explicit ExternalPerfectCache(size_t chunk = 1 << 16) :
+        chunk_(std::max<size_t>(chunk, 1)),
+        keys_file_(temp_dir()),
+        next_file_(temp_dir()) { keys_.reserve(chunk_); }
+
+    size_t size() const { return n_page_; }
+
+    // appends keys to the trace, the next hits() redoes the reverse pass then
+    void push(const KeyT* keys, size_t n)
+    {
+        next_done_ = false;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            keys_.push_back(keys[i]);
+            n_page_++;
+
+            if (keys_.size() == chunk_) flush();
+        }
+    }
+
+    // hits of the perfect cache of cache_size pages on the whole trace, the reverse pass is done once;
+    // the resident page requested next is the least next use, so a request is a hit iff it's on top
+    size_t hits(size_t cache_size)
+    {
+        if (!next_done_)
+        {
+            flush();
+            write_next_uses();
+        }
+
+        if (cache_size == 0) return 0;
+
+        size_t hits = 0;
+        std::set<uint64_t>    resident;
+        std::vector<uint64_t> next_use(chunk_);
+
+        for (size_t begin = 0; begin < n_page_; begin += chunk_)
+        {
+            size_t end = std::min(n_page_, begin + chunk_);
+            next_file_.read(next_use.data(), (end - begin) * sizeof(uint64_t), begin * sizeof(uint64_t));
+
+            for (size_t i = begin; i < end; i++)
+            {
+                if (!resident.empty() && *resident.begin() == i)   // in case it's a hit
+                {
+                    hits++;
+                    resident.erase(resident.begin());
+                }
+                else if (resident.size() == cache_size)             // in case cache is full, evict the latest
+                    resident.erase(std::prev(resident.end()));
+
+                resident.insert(next_use[i - begin]);
+            }
+        }
+
+        return hits;
+    }
+};
+
+#endif
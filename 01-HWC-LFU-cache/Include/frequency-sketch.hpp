@@ -0,0 +1,128 @@
+#ifndef FREQUENCY_SKETCH_HPP
+#define FREQUENCY_SKETCH_HPP
+
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "cache-index.hpp"
+
+// approximate frequencies of keys for TinyLFU admission: count-min sketch of DEPTH rows of 4-bit
+// counters packed 16 to a word, in front of it a doorkeeper Bloom filter that takes the first request
+// of every key, so keys requested once don't take counters at all; after every sample of 10 requests
+// per cached page all counters are halved and the doorkeeper is cleared, so old popularity fades away;
+// rows are twice as wide as the capacity, so the sketch takes 4 bytes of counters and 2 bytes of
+// doorkeeper per cached page and never allocates
+template <typename KeyT, typename Hash = std::hash<KeyT>>
+class FrequencySketch
+{
+    static constexpr size_t   DEPTH       = 4;
+    static constexpr uint64_t MAX_COUNTER = 15;
+    static constexpr uint64_t HALF_MASK   = 0x7777777777777777ULL;    // clears the high bit of every counter after >> 1
+
+    size_t                width_ = 1;     // counters in a row, a power of two not less than 2 * capacity
+    size_t                sample_;        // requests between halvings
+    size_t                added_ = 0;
+    std::vector<uint64_t> table_ ;        // DEPTH rows of width_ counters
+    std::vector<uint64_t> door_  ;        // doorkeeper bits, 8 per counter of a row
+    Hash                  hash_  ;
+
+    uint64_t hash(const KeyT& key) const { return mix_hash(hash_(key)); }
+
+    // counter of row i is picked by double hashing of the two halves of h
+    size_t counter(uint64_t h, size_t i) const
+    {
+        size_t column = (uint32_t(h) + i * ((h >> 32) | 1)) & (width_ - 1);
+        return i * width_ + column;
+    }
+
+    uint64_t get(size_t c) const { return (table_[c / 16] >> (c % 16 * 4)) & MAX_COUNTER; }
+
+    // doorkeeper probes two bits taken from other parts of another mix of the hash
+    size_t door_bit(uint64_t h, size_t i) const
+    {
+        uint64_t g = h * 0x9e3779b97f4a7c15ULL;
+        return (i ? uint32_t(g >> 16) : g >> 32) & (door_.size() * 64 - 1);
+    }
+
+    bool door_contains(uint64_t h) const
+    {
+        for (size_t i = 0; i < 2; i++)
+        {
+            size_t bit = door_bit(h, i);
+            if (!(door_[bit / 64] >> (bit % 64) & 1)) return false;
+        }
+
+        return true;
+    }
+
+    // returns false if the key has just been put to the doorkeeper
+    bool door_put(uint64_t h)
+    {
+        if (door_contains(h)) return true;
+
+        for (size_t i = 0; i < 2; i++)
+        {
+            size_t bit = door_bit(h, i);
+            door_[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+
+        return false;
+    }
+
+    void halve()
+    {
+        for (size_t i = 0; i < table_.size(); i++) table_[i] = (table_[i] >> 1) & HALF_MASK;
+        std::fill(door_.begin(), door_.end(), 0);
+        added_ /= 2;
+    }
+
+public:
+    FrequencySketch(size_t capacity) : sample_(10 * std::max<size_t>(capacity, 1))
+    {
+        while (width_ < 2 * capacity) width_ *= 2;
+        if (width_ < 16) width_ = 16;
+
+        table_.assign(DEPTH * width_ / 16, 0);
+        door_ .assign(width_ * 8 / 64, 0);
+    }
+
+    // estimated number of requests of the key in the current sample, at most MAX_COUNTER + 1
+    size_t estimate(const KeyT& key) const
+    {
+        uint64_t h = hash(key);
+        uint64_t freq = MAX_COUNTER;
+
+        for (size_t i = 0; i < DEPTH; i++) freq = std::min(freq, get(counter(h, i)));
+
+        return freq + door_contains(h);
+    }
+
+    // counts a request of the key, only the least counters of the key are incremented (conservative update)
+    void increment(const KeyT& key)
+    {
+        uint64_t h = hash(key);
+
+        if (door_put(h))
+        {
+            size_t   c[DEPTH];
+            uint64_t freq = MAX_COUNTER;
+
+            for (size_t i = 0; i < DEPTH; i++)
+            {
+                c[i] = counter(h, i);
+                freq = std::min(freq, get(c[i]));
+            }
+
+            if (freq != MAX_COUNTER)
+                for (size_t i = 0; i < DEPTH; i++)
+                    if (get(c[i]) == freq) table_[c[i] / 16] += uint64_t(1) << (c[i] % 16 * 4);
+        }
+
+        if (++added_ == sample_) halve();
+    }
+
+    size_t memory_bytes() const { return sizeof(*this) + (table_.capacity() + door_.capacity()) * sizeof(uint64_t); }
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef MISS_RATIO_CURVE_HPP
+#define MISS_RATIO_CURVE_HPP
+
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <cmath>
+#include "perfect-cache.hpp"
+#include "cache-index.hpp"
+
+// Hit curves of a trace for all cache sizes at once: hits[c] is the number of hits of the cache of c pages,
+// c = 0 ... max_capacity. Both LRU and OPT are stack algorithms: the cache of c pages always holds
+// the c pages on top of one stack, so a request at depth d of the stack hits in every cache of d pages or more.
+
+// sums of a prefix of counters in O(log n)
+class FenwickTree
+{
+    std::vector<int64_t> tree_;
+
+public:
+    FenwickTree(size_t n) : tree_(n + 1) {}
+
+    void add(size_t i, int64_t delta)
+    {
+        for (i++; i < tree_.size(); i += i & (~i + 1)) tree_[i] += delta;
+    }
+
+    // sum of counters [0, i)
+    int64_t prefix(size_t i) const
+    {
+        int64_t sum = 0;
+        for (; i > 0; i -= i & (~i + 1)) sum += tree_[i];
+        return sum;
+    }
+};
+
+// depth of a request in LRU stack is the number of distinct keys since the previous request of the key plus 1;
+// only the last request of every key is marked in the tree, so the distinct keys are the marks in between;
+// histogram[d] gets weight of requests of depth d scaled by scale, requests deeper than max_capacity are misses
+// everywhere; the tree has a counter per request, so it takes as much memory as the trace it's given
+template <typename T>
+void lru_stack_distances(const std::vector<int>& page_keys, size_t max_capacity, T weight, std::vector<T>& histogram,
+                         double scale = 1)
+{
+    std::unordered_map<int, size_t> last_request;
+    FenwickTree marks(page_keys.size());
+    size_t time = 0;
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        auto last = last_request.find(page_keys[i]);
+
+        if (last != last_request.end())
+        {
+            size_t depth = std::llround((marks.prefix(time) - marks.prefix(last->second + 1) + 1) * scale);
+            if (depth <= max_capacity) histogram[std::max<size_t>(depth, 1)] += weight;
+
+            marks.add(last->second, -1);
+            last->second = time;
+        }
+        else last_request.emplace(page_keys[i], time);
+
+        marks.add(time++, 1);
+    }
+}
+
+// prefix sums of the histogram of depths
+template <typename T>
+std::vector<T> hits_from_depths(std::vector<T> histogram)
+{
+    for (size_t c = 1; c < histogram.size(); c++) histogram[c] += histogram[c - 1];
+    return histogram;
+}
+
+// exact LRU curve by stack distances in O(n log n)
+inline std::vector<size_t> lru_hits_curve(const std::vector<int>& page_keys, size_t max_capacity)
+{
+    std::vector<size_t> histogram(max_capacity + 1);
+    lru_stack_distances<size_t>(page_keys, max_capacity, 1, histogram);
+
+    return hits_from_depths(histogram);
+}
+
+// approximate LRU curve by SHARDS of Waldspurger et al.: only keys whose hash falls below rate of the hash
+// range are processed, so a sampled key keeps all its requests; depths and counts of the sample are scaled
+// by 1 / rate, and the difference between the expected and the actual number of sampled requests is put
+// to depth 1, which cancels most of the error of the sample size; requests of sampled keys are copied
+// in order first, so the stack distances take memory of the sample rather than of the whole trace
+inline std::vector<double> shards_lru_hits_curve(const std::vector<int>& page_keys, size_t max_capacity, double rate)
+{
+    const uint64_t MODULUS   = 1 << 24;
+    const uint64_t threshold = rate * MODULUS;
+
+    auto sampled = [threshold, MODULUS](int key) { return mix_hash(std::hash<int>()(key)) % MODULUS < threshold; };
+
+    std::vector<double> histogram(max_capacity + 1);
+    if (threshold == 0) return histogram;
+
+    std::vector<int> sample;
+    sample.reserve(page_keys.size() * rate);
+    for (size_t i = 0; i < page_keys.size(); i++)
+        if (sampled(page_keys[i])) sample.push_back(page_keys[i]);
+
+    lru_stack_distances<double>(sample, max_capacity, 1 / rate, histogram, 1 / rate);
+
+    if (max_capacity > 0) histogram[1] += page_keys.size() - sample.size() / rate;
+
+    return hits_from_depths(histogram);
+}
+
+// OPT curve by stack processing of Mattson et al. in O(n * max_capacity): pages on the stack are ordered so
+// that the top c of them are the pages of OPT cache of c pages; the requested page goes to the top and the
+// page it pushed is carried down: at every level the page requested later is carried further, until
+// the carried page takes the place of the requested one, or falls off the bottom of max_capacity pages;
+// priority of a page is the position of its next request, pages that never occur later get unique
+// positions past the end given by next_uses() of perfect_cache_hits
+inline std::vector<size_t> opt_hits_curve(const std::vector<int>& page_keys, size_t max_capacity)
+{
+    size_t n = page_keys.size();
+    std::vector<size_t> next_use = next_uses(n, page_keys);
+
+    // stack of next uses of pages, the requested page is the one whose next use is now
+    std::vector<size_t> stack;
+    std::vector<size_t> histogram(max_capacity + 1);
+    stack.reserve(max_capacity);
+
+    if (max_capacity == 0) return histogram;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (stack.empty())
+        {
+            stack.push_back(next_use[i]);
+            continue;
+        }
+
+        // the requested page always takes the top
+        size_t carry = stack[0];
+        size_t depth = 1;
+
+        if (carry == i)
+        {
+            stack[0] = next_use[i];
+            histogram[1]++;
+            continue;
+        }
+
+        stack[0] = next_use[i];
+
+        for (; depth < stack.size() && stack[depth] != i; depth++)
+            if (stack[depth] > carry) std::swap(stack[depth], carry);
+
+        if (depth < stack.size())
+        {
+            histogram[depth + 1]++;
+            stack[depth] = carry;
+        }
+        else if (stack.size() < max_capacity) stack.push_back(carry);
+    }
+
+    return hits_from_depths(histogram);
+}
+
+#endif
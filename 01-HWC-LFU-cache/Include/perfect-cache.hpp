@@ -3,69 +3,123 @@
 
 #include <iostream>
 #include <unordered_map>
-#include <algorithm>
-#include <iterator>
-#include <list>
+#include <cstdint>
 #include <vector>
+#include <queue>
 
-int perfect_cache_hits(size_t cache_size, int n_page, std::vector<int> page_keys)
+// Belady's OPT by next uses of the requests: next_use[i] is the position of the next request of the page
+// requested at i, pages that never occur later have unique positions past the end
+inline size_t perfect_cache_hits_of_next_uses(size_t cache_size, const std::vector<size_t>& next_use)
 {
-    int hits = 0;
+    if (cache_size == 0) return 0;
 
-    using  VectIt = typename std::vector<int>::iterator;
+    size_t hits = 0;
+    size_t n    = next_use.size();
 
-    std::unordered_map<int, VectIt> next_appearance;
+    // resident[j] means that the page requested at position j is in cache right now,
+    // so a request is a hit iff its own position is marked
+    std::vector<bool> resident(n, false);
 
-    for (int i = n_page - 1; i >= 0; i--)
-        next_appearance[page_keys[i]] = std::find(page_keys.begin() + i + 1, page_keys.end(), page_keys[i]);
+    // next uses of resident pages, the one that occurs the latest is on top;
+    // entries of pages that were hit since are left in the queue and skipped lazily
+    std::priority_queue<size_t> cache;
+    size_t n_resident = 0;
 
-    std::list<int> cache;
-
-    for (int i = 0; i < n_page; i++)
+    for (size_t i = 0; i < n; i++)
     {
-        int cur = page_keys[i];
-        next_appearance[cur] = std::find(page_keys.begin() + i + 1, page_keys.end(), cur);
-
-        if (std::find(cache.begin(), cache.end(), cur) != cache.end())  // in case it's a hit
+        if (resident[i])    // in case it's a hit
         {
             hits++;
-            continue;
+            resident[i] = false;
         }
-
-        if (cache.size() < cache_size)  // in case it isn't a hit and list isn't full
+        else if (n_resident < cache_size)   // in case it isn't a hit and cache isn't full
         {
-            cache.push_back(cur);
-            continue;
+            n_resident++;
         }
-
-        // in case cache is full and the page is new
-        int max_dist = 0;
-        int value_to_delete = -1;
-
-        for (std::list<int>::iterator it = cache.begin(); it != cache.end(); ++it)
+        else    // in case cache is full and the page is new
         {
-            VectIt next = next_appearance[*it];
-
-            // delete page that doesn't occur later
-            if (next == page_keys.end())
+            for (;;)
             {
-                value_to_delete = *it;
-                break;
-            }
+                size_t victim = cache.top();
+                cache.pop();
 
-            // look for the element that occurs the latest
-            if ((next - page_keys.begin()) > max_dist)
-            {
-                max_dist = next - page_keys.begin();
-                value_to_delete = *it;
+                if (victim >= n) break; // page that doesn't occur later
+
+                if (resident[victim])   // page that occurs the latest
+                {
+                    resident[victim] = false;
+                    break;
+                }
             }
         }
 
-        cache.remove(value_to_delete);
-        cache.push_back(cur);
+        if (next_use[i] < n) resident[next_use[i]] = true;
+        cache.push(next_use[i]);
     }
 
     return hits;
 }
 
+// next uses of the first n requests of the trace, see perfect_cache_hits_of_next_uses();
+// they don't depend on cache size, so simulations of several sizes may share them
+inline std::vector<size_t> next_uses(size_t n, const std::vector<int>& page_keys)
+{
+    std::vector<size_t> next_use(n);
+    std::unordered_map<int, size_t> next_appearance;
+
+    for (size_t i = n; i-- > 0;)
+    {
+        auto next = next_appearance.find(page_keys[i]);
+
+        if (next == next_appearance.end())
+        {
+            next_use[i] = n + i;
+            next_appearance.emplace(page_keys[i], i);
+        }
+        else
+        {
+            next_use[i]  = next->second;
+            next->second = i;
+        }
+    }
+
+    return next_use;
+}
+
+int perfect_cache_hits(size_t cache_size, int n_page, const std::vector<int>& page_keys)
+{
+    if (cache_size == 0 || n_page <= 0) return 0;
+
+    return perfect_cache_hits_of_next_uses(cache_size, next_uses(n_page, page_keys));
+}
+
+// the same for a trace remapped to dense ids below universe (see dense-keys.hpp): next appearances
+// are an array indexed by id instead of a hash map
+inline std::vector<size_t> dense_next_uses(const std::vector<uint32_t>& ids, size_t universe)
+{
+    static constexpr size_t NEVER = SIZE_MAX;
+
+    size_t n = ids.size();
+
+    std::vector<size_t> next_use(n);
+    std::vector<size_t> next_appearance(universe, NEVER);
+
+    for (size_t i = n; i-- > 0;)
+    {
+        size_t& next = next_appearance[ids[i]];
+
+        next_use[i] = (next != NEVER) ? next : n + i;
+        next        = i;
+    }
+
+    return next_use;
+}
+
+inline size_t dense_perfect_cache_hits(size_t cache_size, const std::vector<uint32_t>& ids, size_t universe)
+{
+    if (cache_size == 0 || ids.empty()) return 0;
+
+    return perfect_cache_hits_of_next_uses(cache_size, dense_next_uses(ids, universe));
+}
+
 #endif
@@ -0,0 +1,197 @@
+#ifndef SHARDED_CACHE_HPP
+#define SHARDED_CACHE_HPP
+
+#include <unordered_map>
+#include <functional>
+#include <exception>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include "LFU-cache.hpp"
+
+// thread-safe cache that splits keys by hash between independently locked Cache_t shards,
+// capacity of the whole cache is divided between shards as evenly as possible
+template <typename T, typename KeyT = int, typename Hash = std::hash<KeyT>>
+class ShardedCache
+{
+public:
+    struct Stats
+    {
+        size_t hits      = 0;
+        size_t misses    = 0;
+        size_t coalesced = 0;   // misses of get_or_load() that waited for the load of another thread
+    };
+
+private:
+    // load of get_or_load() in progress, id tells it from a later load of the same key
+    struct Flight
+    {
+        std::shared_future<T> result;
+        uint64_t              id;
+    };
+
+    // every shard takes its own cache lines so that locking one doesn't slow down the others
+    struct alignas(64) Shard
+    {
+        std::mutex                             mutex_;
+        Cache_t<T, KeyT>                       cache_;
+        Stats                                  stats_;
+        std::unordered_map<KeyT, Flight, Hash> flights_;
+        uint64_t                               next_flight_ = 0;
+
+        Shard(size_t size) : cache_(size) {}
+
+        // true if the flight is still the current one of the key, it's done then; put() and erase()
+        // drop the flight of the key, so a load that may be older than them isn't cached
+        bool land(const KeyT& key, uint64_t id)
+        {
+            auto it = flights_.find(key);
+            if (it == flights_.end() || it->second.id != id) return false;
+
+            flights_.erase(it);
+            return true;
+        }
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    Hash hash_;
+
+    Shard& shard(const KeyT& key) { return *shards_[mix_hash(hash_(key)) % shards_.size()]; }
+
+public:
+    ShardedCache(size_t size, size_t n_shards = 16)
+    {
+        if (n_shards == 0) n_shards = 1;
+
+        shards_.reserve(n_shards);
+        for (size_t i = 0; i < n_shards; i++)
+            shards_.push_back(std::make_unique<Shard>(size / n_shards + (i < size % n_shards)));
+    }
+
+    size_t n_shards() const { return shards_.size(); }
+
+    // capacity of the shard, shards differ by one page at most
+    size_t shard_capacity(size_t i) const { return shards_[i]->cache_.size_; }
+
+    bool update(const KeyT& key)
+    {
+        Shard& s = shard(key);
+        std::lock_guard<std::mutex> lock(s.mutex_);
+
+        bool hit = s.cache_.update(key);
+        ++(hit ? s.stats_.hits : s.stats_.misses);
+
+        return hit;
+    }
+
+    // returns a copy of cached value, as the page may be evicted by another thread right after the call;
+    // loader is called under the shard lock
+    template <typename F>
+    T get(const KeyT& key, F loader)
+    {
+        Shard& s = shard(key);
+        std::lock_guard<std::mutex> lock(s.mutex_);
+
+        // the page is looked up once, the loader tells a miss from a hit
+        bool missed = false;
+        T    value  = s.cache_.get(key, [&missed, &loader](const KeyT& k) { missed = true; return loader(k); });
+
+        ++(missed ? s.stats_.misses : s.stats_.hits);
+        return value;
+    }
+
+    // returns a copy of cached value; concurrent misses of the same key are coalesced: the first one
+    // registers a shared future of the load and calls loader without the lock, the others wait for
+    // that future without the lock as well, so loader is called once per key rather than once per thread,
+    // and hits and misses of other keys of the shard aren't held up by the load. If loader throws,
+    // every waiter gets the exception and nothing is cached
+    template <typename F>
+    T get_or_load(const KeyT& key, F loader)
+    {
+        Shard& s = shard(key);
+        std::unique_lock<std::mutex> lock(s.mutex_);
+
+        T* value = s.cache_.find(key);
+        if (value)
+        {
+            s.stats_.hits++;
+            return *value;
+        }
+
+        auto flight = s.flights_.find(key);
+        if (flight != s.flights_.end())
+        {
+            std::shared_future<T> result = flight->second.result;
+            s.stats_.coalesced++;
+
+            lock.unlock();
+            return result.get();
+        }
+
+        std::promise<T> promise;
+        uint64_t        id = s.next_flight_++;
+
+        s.flights_.emplace(key, Flight{ promise.get_future().share(), id });
+        s.stats_.misses++;
+        lock.unlock();
+
+        try
+        {
+            T loaded = loader(key);
+
+            lock.lock();
+            if (s.land(key, id)) s.cache_.put(key, loaded);
+            lock.unlock();
+
+            promise.set_value(loaded);
+            return loaded;
+        }
+        catch (...)
+        {
+            if (!lock.owns_lock()) lock.lock();
+            s.land(key, id);
+            lock.unlock();
+
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    bool put(const KeyT& key, T value)
+    {
+        Shard& s = shard(key);
+        std::lock_guard<std::mutex> lock(s.mutex_);
+
+        s.flights_.erase(key);
+        return s.cache_.put(key, std::move(value));
+    }
+
+    bool erase(const KeyT& key)
+    {
+        Shard& s = shard(key);
+        std::lock_guard<std::mutex> lock(s.mutex_);
+
+        s.flights_.erase(key);
+        return s.cache_.erase(key);
+    }
+
+    // sums statistics of all shards, each shard is read under its lock
+    Stats stats()
+    {
+        Stats total;
+
+        for (size_t i = 0; i < shards_.size(); i++)
+        {
+            std::lock_guard<std::mutex> lock(shards_[i]->mutex_);
+            total.hits      += shards_[i]->stats_.hits;
+            total.misses    += shards_[i]->stats_.misses;
+            total.coalesced += shards_[i]->stats_.coalesced;
+        }
+
+        return total;
+    }
+};
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef STATIC_CACHE_HPP
+#define STATIC_CACHE_HPP
+
+#include <iostream>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <array>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// LFU cache of at most N pages whose storage is a member array, so it never allocates and a small one
+// fits in a few lines of L1; it's meant for per-thread or per-connection caches of known capacity.
+// Pages are kept packed in [0, size) in the order of eviction, as if the frequency buckets of LFU
+// were laid out one after another: by frequency, and pages of the same frequency by recency.
+// A key is found by a linear scan, 4 keys per SSE2 comparison for 32-bit integer keys, the victim
+// is always the first page, and a hit moves the page past the pages of its new frequency, so hits
+// are exactly the ones of Cache_t with LFU (without aging). Only keys, frequencies and slots move,
+// a value stays in its slot as long as its page is cached, as values of Cache_t do.
+// Scans and moves are O(N), large N are for Cache_t
+template <typename T, typename KeyT, size_t N>
+class StaticCache
+{
+    static_assert(N > 0 && N < UINT32_MAX, "capacity of StaticCache is 1 ... 2^32 - 2 pages");
+
+    static constexpr uint32_t NIL    = UINT32_MAX;
+    static constexpr size_t   LANES  = 4;
+    static constexpr size_t   STRIDE = (N + LANES - 1) / LANES * LANES;   // keys are read by whole vectors
+
+    static constexpr bool SIMD_KEYS = std::is_integral<KeyT>::value && sizeof(KeyT) == 4;
+
+    std::array<KeyT, STRIDE>     keys_   = {};
+    std::array<uint32_t, STRIDE> freqs_  = {};  // frequencies saturate at UINT32_MAX
+    std::array<uint32_t, N>      slots_  = slots();  // slots of values of pages, then the free ones
+    std::array<T, N>             values_ = {};
+    uint32_t                     size_ = 0;
+
+    static constexpr std::array<uint32_t, N> slots()
+    {
+        std::array<uint32_t, N> identity = {};
+        for (uint32_t i = 0; i < N; i++) identity[i] = i;
+        return identity;
+    }
+
+    uint32_t position(const KeyT& key) const
+    {
+#ifdef __SSE2__
+        if constexpr (SIMD_KEYS)
+        {
+            int32_t pattern = 0;
+            memcpy(&pattern, &key, sizeof(pattern));
+
+            __m128i needle = _mm_set1_epi32(pattern);
+
+            for (uint32_t i = 0; i < size_; i += LANES)
+            {
+                __m128i  group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&keys_[i]));
+                unsigned match = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(group, needle)));
+
+                // lanes past size_ hold keys of erased or evicted pages
+                if (size_ - i < LANES) match &= (1u << (size_ - i)) - 1;
+                if (match) return i + __builtin_ctz(match);
+            }
+
+            return NIL;
+        }
+#endif
+
+        for (uint32_t i = 0; i < size_; i++)
+            if (keys_[i] == key) return i;
+
+        return NIL;
+    }
+
+    // moves the page at from to to, the pages in between move by one towards from
+    void move(uint32_t from, uint32_t to)
+    {
+        if (from < to)
+        {
+            std::rotate(&keys_ [from], &keys_ [from + 1], &keys_ [to + 1]);
+            std::rotate(&freqs_[from], &freqs_[from + 1], &freqs_[to + 1]);
+            std::rotate(&slots_[from], &slots_[from + 1], &slots_[to + 1]);
+        }
+        else if (to < from)
+        {
+            std::rotate(&keys_ [to], &keys_ [from], &keys_ [from + 1]);
+            std::rotate(&freqs_[to], &freqs_[from], &freqs_[from + 1]);
+            std::rotate(&slots_[to], &slots_[from], &slots_[from + 1]);
+        }
+    }
+
+    // the first position past the pages of frequency freq or less, starting from the page at i
+    uint32_t end_of(uint32_t freq, uint32_t i) const
+    {
+#ifdef __SSE2__
+        // SSE2 compares signed numbers only, so the sign bits of both sides are flipped
+        const __m128i sign  = _mm_set1_epi32(INT32_MIN);
+        const __m128i bound = _mm_xor_si128(_mm_set1_epi32(freq), sign);
+
+        for (; i + LANES <= size_; i += LANES)
+        {
+            __m128i  group   = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&freqs_[i])), sign);
+            unsigned greater = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(group, bound)));
+
+            if (greater) return i + __builtin_ctz(greater);
+        }
+#endif
+
+        while (i < size_ && freqs_[i] <= freq) i++;
+        return i;
+    }
+
+    // the page goes to the recent end of the bucket of its new frequency
+    uint32_t touch(uint32_t i)
+    {
+        if (freqs_[i] != UINT32_MAX) freqs_[i]++;
+
+        uint32_t to = end_of(freqs_[i], i + 1) - 1;
+        move(i, to);
+
+        return to;
+    }
+
+    // the victim is the first page, the new one goes after the pages of frequency 1 and takes the slot
+    // of the victim or the first free one
+    uint32_t insert(const KeyT& key, T&& value)
+    {
+        uint32_t i  = (size_ == N) ? 0 : size_;
+        uint32_t to = (size_ == N) ? end_of(1, 1) - 1 : end_of(1, 0);
+
+        if (size_ < N) size_++;
+
+        keys_  [i]         = key;
+        freqs_ [i]         = 1;
+        values_[slots_[i]] = std::move(value);
+
+        move(i, to);
+        return to;
+    }
+
+public:
+    static constexpr size_t capacity() { return N; }
+
+    size_t size()    const { return size_; }
+    bool   is_full() const { return size_ == N; }
+
+    bool update(const KeyT& key)
+    {
+        uint32_t hit = position(key);
+
+        if (hit != NIL)
+        {
+            touch(hit);
+            return true;
+        }
+
+        insert(key, T());
+        return false;
+    }
+
+    // returns cached value of the page or nullptr without counting the page as requested
+    const T* peek(const KeyT& key) const
+    {
+        uint32_t hit = position(key);
+        return (hit != NIL) ? &values_[slots_[hit]] : nullptr;
+    }
+
+    // returns cached value of the page or nullptr, a found page counts as requested
+    T* find(const KeyT& key)
+    {
+        uint32_t hit = position(key);
+        if (hit == NIL) return nullptr;
+
+        return &values_[slots_[touch(hit)]];
+    }
+
+    // returns cached value of the page, calls loader(key) to get it in case of a miss;
+    // the reference stays valid until the page is evicted or erased
+    template <typename F>
+    T& get(const KeyT& key, F loader)
+    {
+        T* value = find(key);
+        if (value) return *value;
+
+        return values_[slots_[insert(key, loader(key))]];
+    }
+
+    // puts value to cache replacing the old one, returns true if the page was already there
+    bool put(const KeyT& key, T value)
+    {
+        T* old_value = find(key);
+
+        if (old_value)
+        {
+            *old_value = std::move(value);
+            return true;
+        }
+
+        insert(key, std::move(value));
+        return false;
+    }
+
+    // removes page from cache, returns false if there was no such page
+    bool erase(const KeyT& key)
+    {
+        uint32_t i = position(key);
+        if (i == NIL) return false;
+
+        values_[slots_[i]] = T();   // release resources of the value right away
+        move(i, --size_);
+
+        return true;
+    }
+
+    void dump() const
+    {
+        std::cout << "StaticCache dump: \n{\n";
+        for (uint32_t i = 0; i < size_; i++)
+            std::cout << "    " << keys_[i] << ": freq " << freqs_[i] << "\n";
+        std::cout << "}\n\n";
+    }
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "cache-policy.hpp"
+
+// hierarchical timer wheel of deadlines of cache slots: level l has SLOTS lists, each covering
+// SLOTS^l ticks, and a slot is put to the lowest level whose span holds its deadline, so scheduling
+// and cancelling are O(1); when time reaches a list of an upper level its slots are cascaded down,
+// and the lists of level 0 hold slots due at exactly one tick. A slot moves down at most LEVELS times,
+// so expiry is O(1) per slot however far the clock jumps: occupied lists are found by bit scans of
+// a mask per level. Deadlines beyond the span of all levels wait in a list of their own, which
+// is looked at once per turn of the top level; lists are intrusive, a slot takes 18 bytes
+class TimerWheel
+{
+public:
+    static constexpr unsigned BITS   = 6;
+    static constexpr unsigned SLOTS  = 1u << BITS;
+    static constexpr unsigned LEVELS = 6;       // 2^36 ticks, more than two years of milliseconds
+
+private:
+    static constexpr uint16_t NONE = UINT16_MAX;   // bucket of a slot that isn't scheduled
+    static constexpr uint16_t FAR  = LEVELS * SLOTS;
+
+    uint64_t              now_ = 0;
+    SlotLinks             links_;
+    SlotList              lists_[LEVELS * SLOTS + 1];   // the last one is FAR
+    uint64_t              occupied_[LEVELS] = {};        // bit s of level l is set if its list s isn't empty
+    std::vector<uint64_t> deadline_;
+    std::vector<uint16_t> bucket_;
+
+    static unsigned digit(uint64_t time, unsigned level) { return (time >> (BITS * level)) & (SLOTS - 1); }
+
+    // the first tick of the current turn of the level
+    uint64_t turn(unsigned level) const
+    {
+        unsigned shift = BITS * (level + 1);
+        return (shift < 64) ? now_ & ~((uint64_t(1) << shift) - 1) : 0;
+    }
+
+    void link(uint32_t slot, uint16_t bucket)
+    {
+        bucket_[slot] = bucket;
+        lists_[bucket].push_back(links_, slot);
+        if (bucket != FAR) occupied_[bucket / SLOTS] |= uint64_t(1) << (bucket % SLOTS);
+    }
+
+    void unlink(uint32_t slot)
+    {
+        uint16_t bucket = bucket_[slot];
+
+        lists_[bucket].remove(links_, slot);
+        if (bucket != FAR && lists_[bucket].size == 0) occupied_[bucket / SLOTS] &= ~(uint64_t(1) << (bucket % SLOTS));
+
+        bucket_[slot] = NONE;
+    }
+
+    // deadline is later than now_: the level is the highest digit where they differ
+    void place(uint32_t slot)
+    {
+        uint64_t differ = deadline_[slot] ^ now_;
+        unsigned level  = (63 - __builtin_clzll(differ)) / BITS;
+
+        if (level >= LEVELS) link(slot, FAR);
+        else                 link(slot, level * SLOTS + digit(deadline_[slot], level));
+    }
+
+    // the earliest tick after now_ when a list has to be cascaded or expired
+    uint64_t next_event() const
+    {
+        uint64_t next = UINT64_MAX;
+
+        for (unsigned level = 0; level < LEVELS; level++)
+        {
+            unsigned current = digit(now_, level);
+            uint64_t later   = (current + 1 < SLOTS) ? occupied_[level] & ~((uint64_t(2) << current) - 1) : 0;
+
+            if (later) next = std::min(next, turn(level) + (uint64_t(__builtin_ctzll(later)) << (BITS * level)));
+        }
+
+        if (lists_[FAR].size)
+        {
+            uint64_t top_turn = uint64_t(1) << (BITS * LEVELS);
+            next = std::min(next, (now_ & ~(top_turn - 1)) + top_turn);
+        }
+
+        return next;
+    }
+
+    // moves slots of the list to the levels below, slots due right now are expired; the list is taken
+    // away first, as far deadlines go back to the same list
+    template <typename F>
+    void cascade(uint16_t bucket, F& expire)
+    {
+        SlotList list = lists_[bucket];
+
+        lists_[bucket] = SlotList();
+        if (bucket != FAR) occupied_[bucket / SLOTS] &= ~(uint64_t(1) << (bucket % SLOTS));
+
+        while (list.size)
+        {
+            uint32_t slot = list.pop_front(links_);
+            bucket_[slot] = NONE;
+
+            if (deadline_[slot] <= now_) expire(slot);
+            else                         place(slot);
+        }
+    }
+
+public:
+    TimerWheel(size_t capacity, uint64_t now = 0) : now_(now), links_(capacity)
+    {
+        deadline_.reserve(capacity);
+        bucket_  .reserve(capacity);
+    }
+
+    uint64_t now() const { return now_; }
+
+    bool scheduled(uint32_t slot) const { return slot < bucket_.size() && bucket_[slot] != NONE; }
+
+    uint64_t deadline(uint32_t slot) const { return deadline_[slot]; }
+
+    // the slot must not be scheduled; returns false if the deadline has already come
+    bool schedule(uint32_t slot, uint64_t deadline)
+    {
+        if (deadline <= now_) return false;
+
+        if (slot >= bucket_.size())
+        {
+            links_.fit(slot);
+            deadline_.resize(slot + 1);
+            bucket_  .resize(slot + 1, NONE);
+        }
+
+        deadline_[slot] = deadline;
+        place(slot);
+        return true;
+    }
+
+    void cancel(uint32_t slot)
+    {
+        if (scheduled(slot)) unlink(slot);
+    }
+
+    // moves time to now, expire(slot) is called for every slot whose deadline has come, after it's
+    // unscheduled; time never goes back
+    template <typename F>
+    void advance(uint64_t now, F expire)
+    {
+        for (uint64_t next = next_event(); next <= now; next = next_event())
+        {
+            now_ = next;
+
+            if (lists_[FAR].size && (now_ & ((uint64_t(1) << (BITS * LEVELS)) - 1)) == 0) cascade(FAR, expire);
+
+            for (unsigned level = LEVELS; level-- > 0;)
+            {
+                uint64_t below = (uint64_t(1) << (BITS * level)) - 1;
+                if (now_ & below) continue;
+
+                cascade(level * SLOTS + digit(now_, level), expire);
+            }
+        }
+
+        if (now > now_) now_ = now;
+    }
+
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + links_.memory_bytes() + deadline_.capacity() * sizeof(uint64_t) +
+               bucket_.capacity() * sizeof(uint16_t);
+    }
+};
+
+#endif
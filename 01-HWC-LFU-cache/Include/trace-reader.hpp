@@ -0,0 +1,156 @@
+#ifndef TRACE_READER_HPP
+#define TRACE_READER_HPP
+
+#include <system_error>
+#include <stdexcept>
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// reads integers separated by whitespace from a text trace: a file is mapped to memory and numbers
+// are parsed by std::from_chars right from the mapping, standard input (pipes) is read in chunks of
+// CHUNK bytes; throws std::system_error if the file can't be read and std::runtime_error on a bad number
+class TraceReader
+{
+    static constexpr size_t CHUNK = 1 << 20;
+
+    int               fd_     = -1;     // mapped file or -1 for standard input
+    char*             map_    = nullptr;
+    size_t            size_   = 0;      // size of the mapping
+    std::vector<char> buffer_;          // chunk of standard input
+    const char*       pos_    = nullptr;
+    const char*       end_    = nullptr;
+    bool              eof_    = true;   // nothing is left beyond end_
+
+    static bool is_space(char c) { return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+    // moves the unread tail of the chunk to its front and appends the next chunk of standard input,
+    // returns false if nothing was added
+    bool refill()
+    {
+        if (eof_) return false;
+
+        size_t left = end_ - pos_;
+        memmove(buffer_.data(), pos_, left);
+
+        if (buffer_.size() < left + CHUNK) buffer_.resize(left + CHUNK);
+
+        ssize_t n = 0;
+        while ((n = ::read(STDIN_FILENO, buffer_.data() + left, CHUNK)) < 0 && errno == EINTR) {}
+
+        if (n < 0) throw std::system_error(errno, std::generic_category(), "can't read standard input");
+        if (n == 0) eof_ = true;
+
+        pos_ = buffer_.data();
+        end_ = pos_ + left + n;
+
+        return n > 0;
+    }
+
+public:
+    // reads standard input if path is nullptr or "-"
+    explicit TraceReader(const char* path = nullptr)
+    {
+        if (!path || !strcmp(path, "-"))
+        {
+            eof_ = false;
+            buffer_.resize(CHUNK);
+            pos_ = end_ = buffer_.data();
+            return;
+        }
+
+        fd_ = open(path, O_RDONLY);
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), std::string("can't open ") + path);
+
+        struct stat st = {};
+        if (fstat(fd_, &st) < 0)
+        {
+            int error = errno;
+            close(fd_);
+            throw std::system_error(error, std::generic_category(), std::string("can't stat ") + path);
+        }
+
+        size_ = st.st_size;
+
+        if (size_ != 0)
+        {
+            void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+            if (map == MAP_FAILED)
+            {
+                int error = errno;
+                close(fd_);
+                throw std::system_error(error, std::generic_category(), std::string("can't map ") + path);
+            }
+
+            map_ = static_cast<char*>(map);
+            madvise(map_, size_, MADV_SEQUENTIAL);
+        }
+
+        pos_ = map_;
+        end_ = map_ + size_;
+    }
+
+    TraceReader(const TraceReader&)            = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    ~TraceReader()
+    {
+        if (map_)     munmap(map_, size_);
+        if (fd_ >= 0) close(fd_);
+    }
+
+    // returns false at the end of the trace
+    template <typename IntT>
+    bool next(IntT& value)
+    {
+        for (;;)
+        {
+            while (pos_ != end_ && is_space(*pos_)) pos_++;
+
+            if (pos_ == end_)
+            {
+                if (refill()) continue;
+                return false;
+            }
+
+            // the number may be cut by the end of the chunk, even right after its sign, so the whole token
+            // is found first; refill() moves it to the front of the buffer even if nothing is added,
+            // so it's looked for again from the new pos_ after every refill
+            const char* token_end = pos_;
+            while (token_end != end_ && !is_space(*token_end)) token_end++;
+
+            if (token_end == end_ && !eof_)
+            {
+                refill();
+                continue;
+            }
+
+            std::from_chars_result result = std::from_chars(pos_, token_end, value);
+
+            if (result.ec != std::errc() || result.ptr != token_end)
+                throw std::runtime_error("bad number in trace: " + std::string(pos_, std::min<size_t>(token_end - pos_, 20)));
+
+            pos_ = result.ptr;
+            return true;
+        }
+    }
+
+    // reads up to n values, returns how many were read
+    template <typename IntT>
+    size_t read(IntT* values, size_t n)
+    {
+        size_t i = 0;
+        while (i < n && next(values[i])) i++;
+        return i;
+    }
+};
+
+#endif
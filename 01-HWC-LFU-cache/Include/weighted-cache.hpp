@@ -0,0 +1,159 @@
+#ifndef WEIGHTED_CACHE_HPP
+#define WEIGHTED_CACHE_HPP
+
+#include <iostream>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "cache-slots.hpp"
+
+// cache of pages of different weights (bytes) whose capacity is the total weight: every insertion
+// carries the weight of the page, and the policy gives as many victims as it takes to make room;
+// a page heavier than the whole capacity isn't cached at all. max_pages bounds the number of pages,
+// pages are kept in CacheSlots reserved for it at once, and it's the capacity the policy is built with.
+// GDSF by default, as it ranks pages by frequency per byte, but any policy of cache-policy.hpp works
+template <typename T, typename KeyT = int, template <typename> class PolicyT = GDSF, typename IndexT = FlatIndex<KeyT>>
+class WeightedCache : CacheSlots<T, KeyT, PolicyT, IndexT>
+{
+    using Slots = CacheSlots<T, KeyT, PolicyT, IndexT>;
+    using Slots::NIL;
+    using Slots::values_;
+    using Slots::policy_;
+    using Slots::hash_t_;
+    using Slots::key_of;
+
+    size_t                capacity_  ;
+    size_t                max_pages_ ;
+    size_t                weight_ = 0;  // total weight of cached pages
+    std::vector<size_t>   weights_   ;  // weights of pages by slot
+    T                     uncached_  ;  // value returned by get() when the page isn't cached
+
+    void evict() { weight_ -= weights_[this->evict_victim()]; }
+
+    // returns NIL if the page is too heavy to be cached
+    uint32_t insert(const KeyT& key, T&& value, size_t weight)
+    {
+        if (weight > capacity_ || max_pages_ == 0) return NIL;
+
+        policy_.on_miss(key);
+        while (weight_ + weight > capacity_ || hash_t_.size() == max_pages_) evict();
+
+        uint32_t slot = this->add_page(key, std::move(value));
+
+        if (slot == weights_.size()) weights_.push_back(weight);
+        else                         weights_[slot] = weight;
+
+        weight_ += weight;
+        policy_.on_weight(slot, weight);
+        return slot;
+    }
+
+public:
+    // policy_args are passed to the policy constructor after max_pages
+    template <typename... Args>
+    WeightedCache(size_t capacity, size_t max_pages, Args&&... policy_args) :
+        Slots(max_pages, std::forward<Args>(policy_args)...),
+        capacity_(capacity),
+        max_pages_(max_pages) { weights_.reserve(max_pages_); }
+
+    size_t capacity() const { return capacity_; }
+    size_t weight()   const { return weight_; }
+    size_t size()     const { return hash_t_.size(); }
+
+    // the page is requested, its weight only matters if it's missed
+    bool update(const KeyT& key, size_t weight)
+    {
+        if (find(key)) return true;
+
+        insert(key, T(), weight);
+        return false;
+    }
+
+    const T* peek(const KeyT& key) const
+    {
+        uint32_t hit = hash_t_.find(key, key_of());
+        return (hit != NIL) ? &values_[hit] : nullptr;
+    }
+
+    // returns cached value of the page or nullptr, a found page counts as requested
+    T* find(const KeyT& key)
+    {
+        uint32_t hit = hash_t_.find(key, key_of());
+        if (hit == NIL) return nullptr;
+
+        policy_.on_hit(hit, key);
+        return &values_[hit];
+    }
+
+    // loader(key) returns std::pair of the value and its weight; the reference stays valid until
+    // the page is evicted or erased, or until the next get() if the page is too heavy to be cached
+    template <typename F>
+    T& get(const KeyT& key, F loader)
+    {
+        T* value = find(key);
+        if (value) return *value;
+
+        std::pair<T, size_t> loaded = loader(key);
+
+        uint32_t slot = insert(key, std::move(loaded.first), loaded.second);
+        if (slot == NIL) return uncached_ = std::move(loaded.first);
+
+        return values_[slot];
+    }
+
+    // puts value to cache replacing the old one, returns true if the page was already there;
+    // if the new weight is greater, other pages or the page itself may be evicted to make room
+    bool put(const KeyT& key, T value, size_t weight)
+    {
+        uint32_t slot = hash_t_.find(key, key_of());
+
+        if (slot == NIL)
+        {
+            insert(key, std::move(value), weight);
+            return false;
+        }
+
+        policy_.on_hit(slot, key);
+
+        if (weight > capacity_)
+        {
+            erase(key);
+            return true;
+        }
+
+        values_[slot]  = std::move(value);
+        weight_       += weight - weights_[slot];
+        weights_[slot] = weight;
+        policy_.on_weight(slot, weight);
+
+        while (weight_ > capacity_) evict();
+        return true;
+    }
+
+    // removes page from cache, returns false if there was no such page
+    bool erase(const KeyT& key)
+    {
+        uint32_t slot = hash_t_.find(key, key_of());
+        if (slot == NIL) return false;
+
+        weight_ -= weights_[slot];
+        this->erase_slot(slot);
+
+        return true;
+    }
+
+    void dump() const
+    {
+        std::cout << "WeightedCache dump: " << weight_ << " of " << capacity_ << "\n{\n";
+        policy_.dump(key_of());
+        std::cout << "}\n\n";
+    }
+
+    // bytes taken by the cache besides keys and values
+    size_t metadata_bytes() const
+    {
+        return sizeof(*this) + weights_.capacity() * sizeof(size_t) + this->slots_bytes();
+    }
+};
+
+#endif
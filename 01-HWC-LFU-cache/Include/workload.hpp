@@ -0,0 +1,117 @@
+#ifndef WORKLOAD_HPP
+#define WORKLOAD_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <cmath>
+
+// synthetic traces for benchmarks, all of them are reproducible from the seed:
+//     zipf    - keys of [0, 10 * capacity) drawn by Zipf's law with exponent alpha, key 0 is the most popular
+//     uniform - keys of [0, 10 * capacity) drawn uniformly
+//     scan    - keys 0, 1, 2 ... that never repeat
+//     loop    - keys 0, 1 ... L - 1 repeated in a loop a quarter longer than capacity, so LRU never hits
+//     hotspot - zipf whose keys are shifted by a tenth of their range ten times during the trace
+enum class Workload { ZIPF, UNIFORM, SCAN, LOOP, HOTSPOT };
+
+static const char* const WORKLOAD_NAMES[] = { "zipf", "uniform", "scan", "loop", "hotspot" };
+
+inline const char* workload_name(Workload workload) { return WORKLOAD_NAMES[int(workload)]; }
+
+// returns false if there is no workload with the name
+inline bool parse_workload(const char* name, Workload& workload)
+{
+    for (int i = 0; i < 5; i++)
+        if (!strcmp(name, WORKLOAD_NAMES[i]))
+        {
+            workload = Workload(i);
+            return true;
+        }
+
+    return false;
+}
+
+// ranks 0 ... n - 1 distributed by Zipf's law with exponent alpha, rank 0 is the most frequent;
+// rejection-inversion sampling by Hoermann and Derflinger takes O(1) memory and time for any n
+class ZipfGenerator
+{
+    double   alpha_;
+    uint64_t n_;
+    double   h_integral_x1_;
+    double   h_integral_n_;
+    double   s_;
+
+    // log1p(x) / x and expm1(x) / x, precise near 0
+    static double helper1(double x) { return (std::fabs(x) > 1e-8) ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x)); }
+    static double helper2(double x) { return (std::fabs(x) > 1e-8) ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x)); }
+
+    double h(double x) const { return std::exp(-alpha_ * std::log(x)); }
+
+    double h_integral(double x) const
+    {
+        double log_x = std::log(x);
+        return helper2((1 - alpha_) * log_x) * log_x;
+    }
+
+    double h_integral_inverse(double x) const
+    {
+        double t = x * (1 - alpha_);
+        if (t < -1) t = -1;
+        return std::exp(helper1(t) * x);
+    }
+
+public:
+    ZipfGenerator(uint64_t n, double alpha) :
+        alpha_(alpha),
+        n_(n ? n : 1),
+        h_integral_x1_(h_integral(1.5) - 1),
+        h_integral_n_ (h_integral(n_ + 0.5)),
+        s_(2 - h_integral_inverse(h_integral(2.5) - h(2))) {}
+
+    template <typename Generator>
+    uint64_t operator()(Generator& gen)
+    {
+        std::uniform_real_distribution<double> uniform(0, 1);
+
+        for (;;)
+        {
+            double u = h_integral_n_ + uniform(gen) * (h_integral_x1_ - h_integral_n_);
+            double x = h_integral_inverse(u);
+
+            uint64_t k = x + 0.5;
+            if (k < 1)  k = 1;
+            if (k > n_) k = n_;
+
+            if (k - x <= s_ || u >= h_integral(k + 0.5) - h(k)) return k - 1;
+        }
+    }
+};
+
+inline std::vector<int> make_workload(Workload workload, size_t n_requests, size_t capacity, uint64_t seed, double alpha = 0.99)
+{
+    std::mt19937_64 gen(seed);
+    std::vector<int> keys(n_requests);
+
+    size_t universe = 10 * std::max<size_t>(capacity, 1);
+    size_t loop     = capacity + capacity / 4 + 1;
+
+    ZipfGenerator zipf(universe, alpha);
+    std::uniform_int_distribution<size_t> uniform(0, universe - 1);
+
+    for (size_t i = 0; i < n_requests; i++)
+    {
+        switch (workload)
+        {
+            case Workload::ZIPF:    keys[i] = zipf(gen);    break;
+            case Workload::UNIFORM: keys[i] = uniform(gen); break;
+            case Workload::SCAN:    keys[i] = i;            break;
+            case Workload::LOOP:    keys[i] = i % loop;     break;
+            case Workload::HOTSPOT: keys[i] = (zipf(gen) + i * 10 / (n_requests + 1) * (universe / 10)) % universe; break;
+        }
+    }
+
+    return keys;
+}
+
+#endif
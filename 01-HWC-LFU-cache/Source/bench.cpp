@@ -0,0 +1,285 @@
+#ifndef BENCH_CPP
+#define BENCH_CPP
+
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <sys/resource.h>
+#include "../Include/perfect-cache.hpp"
+#include "../Include/LFU-cache.hpp"
+#include "../Include/static-cache.hpp"
+#include "../Include/workload.hpp"
+
+// every allocation of the process is counted, so allocations of a cache are the difference of counters;
+// all forms of new and delete are replaced, and they aren't inlined, so that the compiler doesn't pair
+// malloc() and free() inside them with the new and delete expressions of the callers
+static std::atomic<size_t> n_allocations(0);
+
+#define COUNTING_ALLOCATOR __attribute__((noinline))
+
+COUNTING_ALLOCATOR void* operator new(size_t size)
+{
+    n_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* ptr = malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+COUNTING_ALLOCATOR void* operator new(size_t size, std::align_val_t alignment)
+{
+    n_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    // aligned_alloc() wants the size to be a multiple of the alignment
+    size_t align   = std::max(size_t(alignment), sizeof(void*));
+    size_t rounded = (std::max<size_t>(size, 1) + align - 1) / align * align;
+
+    if (void* ptr = aligned_alloc(align, rounded)) return ptr;
+    throw std::bad_alloc();
+}
+
+COUNTING_ALLOCATOR void* operator new[](size_t size)                             { return operator new(size); }
+COUNTING_ALLOCATOR void* operator new[](size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+
+// nothrow forms count through the throwing ones and return nullptr instead of throwing, as the standard ones do
+COUNTING_ALLOCATOR void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    try { return operator new(size); } catch (const std::bad_alloc&) { return nullptr; }
+}
+
+COUNTING_ALLOCATOR void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    try { return operator new(size, alignment); } catch (const std::bad_alloc&) { return nullptr; }
+}
+
+COUNTING_ALLOCATOR void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+COUNTING_ALLOCATOR void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, alignment, tag);
+}
+
+COUNTING_ALLOCATOR void operator delete  (void* ptr)                           noexcept { free(ptr); }
+COUNTING_ALLOCATOR void operator delete  (void* ptr, size_t)                   noexcept { free(ptr); }
+COUNTING_ALLOCATOR void operator delete  (void* ptr, std::align_val_t)         noexcept { free(ptr); }
+COUNTING_ALLOCATOR void operator delete  (void* ptr, size_t, std::align_val_t) noexcept { free(ptr); }
+COUNTING_ALLOCATOR void operator delete[](void* ptr)                           noexcept { free(ptr); }
+COUNTING_ALLOCATOR void operator delete[](void* ptr, size_t)                   noexcept { free(ptr); }
+COUNTING_ALLOCATOR void operator delete[](void* ptr, std::align_val_t)         noexcept { free(ptr); }
+COUNTING_ALLOCATOR void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { free(ptr); }
+COUNTING_ALLOCATOR void operator delete  (void* ptr, const std::nothrow_t&)                  noexcept { free(ptr); }
+COUNTING_ALLOCATOR void operator delete  (void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { free(ptr); }
+COUNTING_ALLOCATOR void operator delete[](void* ptr, const std::nothrow_t&)                  noexcept { free(ptr); }
+COUNTING_ALLOCATOR void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { free(ptr); }
+
+#undef COUNTING_ALLOCATOR
+
+// resets peak RSS of the process to the current RSS, returns false if the kernel doesn't allow it
+static bool reset_peak_rss()
+{
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    return bool(clear_refs << "5");
+}
+
+// peak RSS since the last reset, or since the start if it can't be reset
+static size_t peak_rss_kb()
+{
+    std::ifstream status("/proc/self/status");
+    std::string field;
+
+    while (status >> field)
+    {
+        size_t kb = 0;
+        if (field == "VmHWM:" && status >> kb) return kb;
+    }
+
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+struct BenchResult
+{
+    double ns_per_op;
+    double allocs_per_op;
+    size_t peak_rss_kb;
+    double hit_ratio;
+};
+
+template <typename F>
+static BenchResult measure(size_t n_requests, F run)
+{
+    reset_peak_rss();
+    size_t allocations = n_allocations.load();
+
+    auto start  = std::chrono::steady_clock::now();
+    size_t hits = run();
+    std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+
+    double n = n_requests ? n_requests : 1;
+    return { time.count() / n, (n_allocations.load() - allocations) / n, peak_rss_kb(), hits / n };
+}
+
+// the cache is constructed inside the measurement, so its allocations and memory are counted too
+template <template <typename> class PolicyT>
+static BenchResult bench_cache(size_t capacity, const std::vector<int>& keys)
+{
+    return measure(keys.size(), [&]
+    {
+        Cache_t<int, int, PolicyT> cache(capacity);
+
+        size_t hits = 0;
+        for (size_t i = 0; i < keys.size(); i++) hits += cache.update(keys[i]);
+
+        return hits;
+    });
+}
+
+template <size_t N>
+static BenchResult bench_static_cache(const std::vector<int>& keys)
+{
+    return measure(keys.size(), [&]
+    {
+        StaticCache<int, int, N> cache;
+
+        size_t hits = 0;
+        for (size_t i = 0; i < keys.size(); i++) hits += cache.update(keys[i]);
+
+        return hits;
+    });
+}
+
+// StaticCache is built only for capacities of the small caches it's meant for
+static bool is_static_capacity(size_t capacity)
+{
+    return capacity == 8 || capacity == 16 || capacity == 32 || capacity == 64;
+}
+
+static BenchResult bench_static(size_t capacity, const std::vector<int>& keys)
+{
+    switch (capacity)
+    {
+        case 8:  return bench_static_cache<8> (keys);
+        case 16: return bench_static_cache<16>(keys);
+        case 32: return bench_static_cache<32>(keys);
+        default: return bench_static_cache<64>(keys);
+    }
+}
+
+static BenchResult bench_perfect_cache(size_t capacity, const std::vector<int>& keys)
+{
+    return measure(keys.size(), [&] { return size_t(perfect_cache_hits(capacity, keys.size(), keys)); });
+}
+
+static bool run_policy(const std::string& policy, size_t capacity, const std::vector<int>& keys, BenchResult& result)
+{
+    auto bench = [&](auto tag) { result = bench_cache<decltype(tag)::template Policy>(capacity, keys); };
+
+    if (dispatch_policy(policy, bench)) return true;
+
+    if      (policy == "static") result = bench_static       (capacity, keys);
+    else if (policy == "opt")    result = bench_perfect_cache(capacity, keys);
+    else return false;
+
+    return true;
+}
+
+static std::vector<std::string> split(const char* list)
+{
+    std::vector<std::string> items;
+    std::string item;
+
+    for (const char* c = list;; c++)
+    {
+        if (*c && *c != ',') { item += *c; continue; }
+
+        if (!item.empty()) items.push_back(item);
+        item.clear();
+
+        if (!*c) return items;
+    }
+}
+
+static const char* USAGE =
+    " [--workloads zipf,uniform,scan,loop,hotspot] [--capacities 10,100,...] [--policies lfu,lru,2q,arc,tinylfu,gdsf,static,opt]\n"
+    "       [--requests N] [--alpha A] [--seed S]\n";
+
+// prints a JSON line per workload, capacity and policy; by default a trace has max(10^6, 2 * capacity)
+// requests, capacities are 10, 100 ... 10^7 and every policy but static runs; static policy runs only
+// at capacities 8, 16, 32 and 64
+int main(int argc, char** argv)
+{
+    std::vector<std::string> workloads  = split("zipf,uniform,scan,loop,hotspot");
+    std::vector<std::string> capacities = split("10,100,1000,10000,100000,1000000,10000000");
+    std::vector<std::string> policies   = split("lfu,lru,2q,arc,tinylfu,gdsf,opt");
+
+    size_t   n_requests = 0;
+    double   alpha      = 0.99;
+    uint64_t seed       = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if      (!strcmp(argv[i], "--workloads")  && i + 1 < argc) workloads  = split(argv[++i]);
+        else if (!strcmp(argv[i], "--capacities") && i + 1 < argc) capacities = split(argv[++i]);
+        else if (!strcmp(argv[i], "--policies")   && i + 1 < argc) policies   = split(argv[++i]);
+        else if (!strcmp(argv[i], "--requests")   && i + 1 < argc) n_requests = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--alpha")      && i + 1 < argc) alpha      = strtod(argv[++i], nullptr);
+        else if (!strcmp(argv[i], "--seed")       && i + 1 < argc) seed       = strtoull(argv[++i], nullptr, 10);
+        else
+        {
+            std::cerr << "usage: " << argv[0] << USAGE;
+            return 1;
+        }
+    }
+
+    for (const std::string& name : workloads)
+    {
+        Workload workload;
+        if (!parse_workload(name.c_str(), workload))
+        {
+            std::cerr << "unknown workload " << name << "\n";
+            return 1;
+        }
+
+        for (const std::string& capacity_str : capacities)
+        {
+            size_t capacity = strtoull(capacity_str.c_str(), nullptr, 10);
+            size_t n        = n_requests ? n_requests : std::max<size_t>(1000000, 2 * capacity);
+
+            std::vector<int> keys = make_workload(workload, n, capacity, seed, alpha);
+
+            for (const std::string& policy : policies)
+            {
+                if (policy == "static" && !is_static_capacity(capacity)) continue;
+
+                BenchResult result;
+                if (!run_policy(policy, capacity, keys, result))
+                {
+                    std::cerr << "unknown policy " << policy << "\n";
+                    return 1;
+                }
+
+                fprintf(stdout, "{\"workload\": \"%s\", \"alpha\": %g, \"seed\": %llu, \"capacity\": %zu, \"requests\": %zu, "
+                                "\"policy\": \"%s\", \"ns_per_op\": %.2f, \"allocs_per_op\": %.6f, \"peak_rss_kb\": %zu, "
+                                "\"hit_ratio\": %.6f}\n",
+                        name.c_str(), alpha, (unsigned long long)seed, capacity, n, policy.c_str(),
+                        result.ns_per_op, result.allocs_per_op, result.peak_rss_kb, result.hit_ratio);
+                fflush(stdout);
+            }
+        }
+    }
+
+    return 0;
+}
+
+#endif
@@ -2,38 +2,490 @@
 #define CACHE_CPP
 
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <optional>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include "../Include/perfect-cache.hpp"
+#include "../Include/external-perfect-cache.hpp"
+#include "../Include/miss-ratio-curve.hpp"
 #include "../Include/LFU-cache.hpp"
+#include "../Include/trace-reader.hpp"
+#include "../Include/dense-keys.hpp"
+#include "../Include/cache-hierarchy.hpp"
 
-int main()
+static const size_t KEY_CHUNK = 4096;
+
+// reads the trace, prints hits of the cache with the policy and of the perfect cache;
+// out of core perfect cache keeps the trace in temporary files instead of memory;
+// policy_args are passed to the policy constructor after the capacity
+template <template <typename> class PolicyT, typename... Args>
+static int run(TraceReader& trace, bool external, const char* name, Args... policy_args)
 {
-    size_t correct_tests = 0;
-    size_t cache_size    = 0;
+    size_t cache_size = 0;
+    size_t n_page     = 0;
 
-    std::cin >> cache_size;
-    Cache_t<int> cache(cache_size);
+    if (!trace.next(cache_size) || !trace.next(n_page))
+    {
+        std::cerr << "trace has to start with cache size and number of pages\n";
+        return 1;
+    }
 
-    size_t n_page;
-    std::cin >> n_page;
+    Cache_t<int, int, PolicyT> cache(cache_size, policy_args...);
 
-    int key     = 0;
     size_t hits = 0;
 
+    std::vector<int> page_keys(external ? KEY_CHUNK : n_page);
+    bool chunk_hits[KEY_CHUNK];
+    std::optional<ExternalPerfectCache<int>> external_cache;
+    if (external) external_cache.emplace(KEY_CHUNK * 16);
+
+    // keys are parsed in chunks that stay in L1 while the cache takes them
+    for (size_t done = 0; done < n_page;)
+    {
+        int*   chunk = external ? page_keys.data() : &page_keys[done];
+        size_t n     = trace.read(chunk, std::min(KEY_CHUNK, n_page - done));
+
+        if (n == 0)
+        {
+            std::cerr << "trace ends after " << done << " of " << n_page << " pages\n";
+            return 1;
+        }
+
+        cache.update_batch(chunk, n, chunk_hits);
+        for (size_t i = 0; i < n; i++) hits += chunk_hits[i];
+
+        if (external) external_cache->push(chunk, n);
+        done += n;
+    }
+
+    std::cout << name << " cache: " << hits << "\n";
+    CACHE_STATS_ONLY(std::cerr << cache.stats_json() << "\n";)
+
+    if (external) std::cout << "Perfect cache: " << external_cache->hits(cache_size) << "\n";
+    else          std::cout << "Perfect cache: " << perfect_cache_hits(cache_size, n_page, page_keys) << "\n";
+
+    return 0;
+}
+
+// prints miss ratios of LRU and OPT caches of every size up to max_capacity, computed in one pass each;
+// with shards_rate LRU curve is estimated by sampling keys and OPT is skipped
+static int run_curves(TraceReader& trace, size_t max_capacity, double shards_rate)
+{
+    size_t cache_size = 0;
+    size_t n_page     = 0;
+
+    if (!trace.next(cache_size) || !trace.next(n_page))
+    {
+        std::cerr << "trace has to start with cache size and number of pages\n";
+        return 1;
+    }
+
     std::vector<int> page_keys(n_page);
+    if (trace.read(page_keys.data(), n_page) != n_page)
+    {
+        std::cerr << "trace is shorter than " << n_page << " pages\n";
+        return 1;
+    }
+
+    double n = n_page ? n_page : 1;
+
+    if (shards_rate > 0)
+    {
+        std::vector<double> lru = shards_lru_hits_curve(page_keys, max_capacity, shards_rate);
+
+        std::cout << "capacity  LRU (SHARDS " << shards_rate << ")\n";
+        for (size_t c = 1; c <= max_capacity; c++)
+            fprintf(stdout, "%8zu  %.6f\n", c, std::min(1.0, std::max(0.0, 1 - lru[c] / n)));
+
+        return 0;
+    }
+
+    std::vector<size_t> lru = lru_hits_curve(page_keys, max_capacity);
+    std::vector<size_t> opt = opt_hits_curve(page_keys, max_capacity);
+
+    std::cout << "capacity  LRU       OPT\n";
+    for (size_t c = 1; c <= max_capacity; c++)
+        fprintf(stdout, "%8zu  %.6f  %.6f\n", c, 1 - lru[c] / n, 1 - opt[c] / n);
+
+    return 0;
+}
+
+// calls job(i) for every i below n_jobs by a pool of n_threads threads, each of them takes the next
+// job as soon as it's done with the previous one, so long jobs don't hold up the short ones
+template <typename F>
+static void parallel_for(size_t n_jobs, size_t n_threads, F job)
+{
+    std::atomic<size_t>      next(0);
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < std::min(n_threads, n_jobs); t++)
+        threads.emplace_back([&]()
+        {
+            for (size_t i = next++; i < n_jobs; i = next++) job(i);
+        });
+
+    for (std::thread& thread : threads) thread.join();
+}
+
+struct SweepResult
+{
+    size_t hits    = 0;
+    double seconds = 0;
+};
+
+template <typename F>
+static SweepResult timed(F run)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t hits = run();
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+    return { hits, time.count() };
+}
+
+// hits of the cache replaying the keys in chunks, as run() does
+template <typename CacheT, typename KeyT>
+static size_t replay(CacheT& cache, const std::vector<KeyT>& keys)
+{
+    bool   chunk_hits[KEY_CHUNK];
+    size_t hits = 0;
+
+    for (size_t done = 0; done < keys.size(); done += KEY_CHUNK)
+    {
+        size_t n = std::min(KEY_CHUNK, keys.size() - done);
 
-    for (int i = 0; i < n_page; i++)
+        cache.update_batch(&keys[done], n, chunk_hits);
+        for (size_t i = 0; i < n; i++) hits += chunk_hits[i];
+    }
+
+    return hits;
+}
+
+// reads the trace once and replays it by the cache with the policy and by the perfect cache of every
+// capacity; all of them share the keys and the next uses of OPT read-only and run in parallel on n_threads threads,
+// the cache size in the trace is ignored; if dense is set, keys are remapped to dense ids first,
+// and both simulations index arrays by id instead of hashing keys
+template <template <typename> class PolicyT, typename... Args>
+static int run_sweep(TraceReader& trace, const std::vector<size_t>& capacities, size_t n_threads, bool dense,
+                     const char* name, Args... policy_args)
+{
+    size_t cache_size = 0;
+    size_t n_page     = 0;
+
+    if (!trace.next(cache_size) || !trace.next(n_page))
     {
-        std::cin >> key;
-        page_keys[i] = key;
+        std::cerr << "trace has to start with cache size and number of pages\n";
+        return 1;
+    }
 
-        if (cache.update(key)) ++hits;
-        // cache.dump();
+    std::vector<int> keys(n_page);
+    if (trace.read(keys.data(), n_page) != n_page)
+    {
+        std::cerr << "trace is shorter than " << n_page << " pages\n";
+        return 1;
     }
 
-    std::cout << "LFU     cache: " << hits << "\n";
-    std::cout << "Perfect cache: " << perfect_cache_hits(cache_size, n_page, page_keys) << "\n";
+    auto start = std::chrono::steady_clock::now();
+
+    DenseTrace<int> dense_trace;
+    if (dense)
+    {
+        dense_trace = remap_dense(keys);
+        std::vector<int>().swap(keys);
+
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        fprintf(stdout, "%zu keys remapped to dense ids in %.1f ms\n", dense_trace.universe(), time.count() * 1e3);
+    }
+
+    const std::vector<int>&      page_keys = keys;
+    const std::vector<uint32_t>& ids       = dense_trace.ids;
+    size_t                       universe  = dense_trace.universe();
+
+    // next uses don't depend on capacity, so all perfect cache jobs read the same ones
+    auto next_start = std::chrono::steady_clock::now();
+
+    const std::vector<size_t> next_use = dense ? dense_next_uses(ids, universe) : next_uses(n_page, page_keys);
+
+    std::chrono::duration<double> next_time = std::chrono::steady_clock::now() - next_start;
+    fprintf(stdout, "next uses of OPT found in %.1f ms\n", next_time.count() * 1e3);
+
+    // job 2 * c is the policy at capacities[c], job 2 * c + 1 is the perfect cache
+    std::vector<SweepResult> results(2 * capacities.size());
+
+    parallel_for(results.size(), n_threads, [&](size_t job)
+    {
+        size_t capacity = capacities[job / 2];
+
+        if (job % 2)    results[job] = timed([&] { return perfect_cache_hits_of_next_uses(capacity, next_use); });
+        else if (dense)       results[job] = timed([&]
+        {
+            Cache_t<int, uint32_t, PolicyT, DenseIndex<uint32_t>> cache(capacity, policy_args...);
+            return replay(cache, ids);
+        });
+        else results[job] = timed([&]
+        {
+            Cache_t<int, int, PolicyT> cache(capacity, policy_args...);
+            return replay(cache, page_keys);
+        });
+    });
+
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+    fprintf(stdout, "capacity  %s hits       ms      OPT hits       ms\n", name);
+    for (size_t c = 0; c < capacities.size(); c++)
+        fprintf(stdout, "%8zu  %12zu %8.1f  %12zu %8.1f\n", capacities[c],
+                results[2 * c].hits,     results[2 * c].seconds * 1e3,
+                results[2 * c + 1].hits, results[2 * c + 1].seconds * 1e3);
+
+    fprintf(stdout, "%zu requests, %zu simulations on %zu threads in %.1f ms\n",
+            n_page, results.size(), std::min(n_threads, results.size()), wall.count() * 1e3);
 
     return 0;
 }
 
+// comma separated capacities, returns false if any of them isn't a number
+static bool parse_capacities(const char* list, std::vector<size_t>& capacities)
+{
+    for (const char* c = list; *c;)
+    {
+        char* end = nullptr;
+        capacities.push_back(strtoull(c, &end, 10));
+
+        if (end == c || (*end && *end != ',')) return false;
+        c = *end ? end + 1 : end;
+    }
+
+    return !capacities.empty();
+}
+
+// comma separated latencies of levels followed by the latency of the backend
+static bool parse_latencies(const char* list, std::vector<double>& latencies)
+{
+    for (const char* c = list; *c;)
+    {
+        char* end = nullptr;
+        latencies.push_back(strtod(c, &end));
+
+        if (end == c || (*end && *end != ',')) return false;
+        c = *end ? end + 1 : end;
+    }
+
+    return !latencies.empty();
+}
+
+// replays the trace by the hierarchy of levels given as policy:capacity,policy:capacity...,
+// level 1 first; latencies are the costs of looking into every level and of the backend,
+// 1, 10, 100 ... by default; prints requests and hits of every level and the average latency
+static int run_hierarchy(TraceReader& trace, const char* spec, bool exclusive, std::vector<double> latencies)
+{
+    std::vector<std::unique_ptr<CacheLevel<int>>> levels;
+    std::vector<std::string>                      names;
+
+    for (const char* c = spec; *c;)
+    {
+        const char* colon = strchr(c, ':');
+        char*       end   = nullptr;
+        size_t      capacity = colon ? strtoull(colon + 1, &end, 10) : 0;
+
+        if (!colon || end == colon + 1 || (*end && *end != ','))
+        {
+            std::cerr << "levels have to be given as policy:capacity,policy:capacity...\n";
+            return 1;
+        }
+
+        names.emplace_back(c, colon);
+        levels.push_back(make_cache_level<int>(names.back().c_str(), capacity));
+
+        if (!levels.back())
+        {
+            std::cerr << "unknown policy " << names.back() << ", expected lfu, lru, 2q, arc, tinylfu or gdsf\n";
+            return 1;
+        }
+
+        c = *end ? end + 1 : end;
+    }
+
+    if (levels.empty())
+    {
+        std::cerr << "hierarchy has to have a level at least\n";
+        return 1;
+    }
+
+    if (latencies.empty())
+        for (size_t i = 0, latency = 1; i <= levels.size(); i++, latency *= 10) latencies.push_back(latency);
+
+    if (latencies.size() != levels.size() + 1)
+    {
+        std::cerr << "there have to be " << levels.size() + 1 << " latencies, of every level and of the backend\n";
+        return 1;
+    }
+
+    double backend_latency = latencies.back();
+    latencies.pop_back();
+
+    size_t cache_size = 0;
+    size_t n_page     = 0;
+
+    if (!trace.next(cache_size) || !trace.next(n_page))
+    {
+        std::cerr << "trace has to start with cache size and number of pages\n";
+        return 1;
+    }
+
+    CacheHierarchy<int> hierarchy(std::move(levels), latencies, backend_latency,
+                                  exclusive ? Inclusion::EXCLUSIVE : Inclusion::INCLUSIVE);
+
+    int chunk[KEY_CHUNK];
+    for (size_t done = 0; done < n_page;)
+    {
+        size_t n = trace.read(chunk, std::min(KEY_CHUNK, n_page - done));
+
+        if (n == 0)
+        {
+            std::cerr << "trace ends after " << done << " of " << n_page << " pages\n";
+            return 1;
+        }
+
+        for (size_t i = 0; i < n; i++) hierarchy.update(chunk[i]);
+        done += n;
+    }
+
+    double total = n_page ? n_page : 1;
+
+    fprintf(stdout, "level  policy    capacity      requests          hits  local hit ratio  global hit ratio   latency\n");
+    for (size_t i = 0; i < hierarchy.n_levels(); i++)
+    {
+        const CacheHierarchy<int>::LevelStats& stats = hierarchy.stats(i);
+
+        fprintf(stdout, "%5zu  %-8s %9zu  %12zu  %12zu  %15.6f  %16.6f  %8g\n", i + 1, names[i].c_str(),
+                hierarchy.level(i).capacity(), stats.requests, stats.hits,
+                stats.requests ? double(stats.hits) / stats.requests : 0.0, stats.hits / total, latencies[i]);
+    }
+
+    fprintf(stdout, "backend%20s%12zu  %12zu  %35s  %8g\n", "", hierarchy.misses(), hierarchy.misses(), "", backend_latency);
+    fprintf(stdout, "%s hierarchy, average latency of a request %.4f\n",
+            exclusive ? "exclusive" : "inclusive", hierarchy.average_latency());
+
+    return 0;
+}
+
+static const char* USAGE = " [--policy lfu|lru|2q|arc|tinylfu|gdsf] [--aging K] [--external] [trace.txt]\n"
+                           "       [--mrc MAX [--shards RATE]] [trace.txt]\n"
+                           "       [--policy ...] [--aging K] --sweep C1,C2,... [--threads N] [--dense] [trace.txt]\n"
+                           "       --hierarchy lru:C1,lfu:C2,... [--exclusive] [--latencies L1,L2,...,BACKEND] [trace.txt]\n";
+
+// usage: cache [--policy lfu|lru|2q|arc|tinylfu|gdsf] [--aging K] [--external] [trace.txt],
+// --aging halves frequencies of LFU every K requests, --external computes perfect cache out of core,
+// --mrc prints miss ratio curves of LRU and OPT up to MAX pages instead, --shards estimates LRU curve
+// by sampling RATE (0 < RATE <= 1) of keys, --sweep runs the policy and the perfect cache of every capacity
+// of the list in parallel on N threads (all cores by default), --dense remaps keys of the sweep to dense ids first;
+// --hierarchy chains cache levels, inclusive unless --exclusive, and models the average latency of a request
+// from --latencies of the levels and the backend; the trace is read from stdin if no file is given
+int main(int argc, char** argv)
+{
+    const char* policy   = nullptr;    // lfu unless --policy is given
+    size_t      aging    = 0;
+    const char* path     = nullptr;
+    bool        external = false;
+    bool        dense    = false;
+    size_t      mrc      = 0;
+    double      shards   = 0;
+    size_t      threads  = 0;      // all cores unless --threads is given
+
+    std::vector<size_t> sweep;
+    const char*         hierarchy = nullptr;
+    bool                exclusive = false;
+    std::vector<double> latencies;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if      (!strcmp(argv[i], "--policy") && i + 1 < argc) policy = argv[++i];
+        else if (!strcmp(argv[i], "--aging")  && i + 1 < argc) aging  = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--external"))               external = true;
+        else if (!strcmp(argv[i], "--dense"))                  dense    = true;
+        else if (!strcmp(argv[i], "--mrc")    && i + 1 < argc) mrc    = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--shards") && i + 1 < argc && (shards = strtod(argv[i + 1], nullptr)) > 0 && shards <= 1) i++;
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc && (threads = strtoull(argv[i + 1], nullptr, 10))) i++;
+        else if (!strcmp(argv[i], "--sweep") && i + 1 < argc && parse_capacities(argv[i + 1], sweep)) i++;
+        else if (!strcmp(argv[i], "--hierarchy") && i + 1 < argc) hierarchy = argv[++i];
+        else if (!strcmp(argv[i], "--exclusive"))                 exclusive = true;
+        else if (!strcmp(argv[i], "--latencies") && i + 1 < argc && parse_latencies(argv[i + 1], latencies)) i++;
+        else if (!path && (argv[i][0] != '-' || !strcmp(argv[i], "-"))) path = argv[i];
+        else
+        {
+            std::cerr << "usage: " << argv[0] << USAGE;
+            return 1;
+        }
+    }
+
+    // options that would be ignored by the mode they are given to; curves and levels of a hierarchy
+    // don't simulate the policy of --policy and --aging, nor the perfect cache of --external
+    bool ignored = (shards   && !mrc)                              ||   // --shards only samples the curves of --mrc
+                   (threads  && sweep.empty())                     ||   // only the sweep runs in parallel
+                   (external && !sweep.empty())                    ||   // the sweep keeps the whole trace in memory
+                   (mrc      && !sweep.empty())                    ||   // --mrc, --sweep and --hierarchy
+                   (hierarchy && (mrc || !sweep.empty()))          ||   // are different modes
+                   ((mrc || hierarchy) && (policy || aging || external));
+
+    if (ignored)
+    {
+        std::cerr << "usage: " << argv[0] << USAGE;
+        return 1;
+    }
+
+    if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+    if (!policy)  policy  = "lfu";
+
+    if (aging && strcmp(policy, "lfu"))
+    {
+        std::cerr << "--aging is supported by lfu policy only\n";
+        return 1;
+    }
+
+    if ((exclusive || !latencies.empty()) && !hierarchy)
+    {
+        std::cerr << "--exclusive and --latencies are supported by --hierarchy only\n";
+        return 1;
+    }
+
+    if (dense && sweep.empty())
+    {
+        std::cerr << "--dense is supported by --sweep only\n";
+        return 1;
+    }
+
+    try
+    {
+        TraceReader trace(path);
+
+        if (mrc)                        return run_curves(trace, mrc, shards);
+        if (hierarchy)                  return run_hierarchy(trace, hierarchy, exclusive, latencies);
+
+        if (!sweep.empty() && aging)    return run_sweep<LFU>(trace, sweep, threads, dense, "LFU    ", aging);
+        if (aging)                      return run<LFU>      (trace, external, "LFU    ", aging);
+
+        int  status = 0;
+        auto simulate = [&](auto tag)
+        {
+            using Tag = decltype(tag);
+
+            status = sweep.empty() ? run<Tag::template Policy>      (trace, external, tag.label) :
+                                     run_sweep<Tag::template Policy>(trace, sweep, threads, dense, tag.label);
+        };
+
+        if (dispatch_policy(policy, simulate)) return status;
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+
+    std::cerr << "unknown policy " << policy << ", expected lfu, lru, 2q, arc, tinylfu or gdsf\n";
+    return 1;
+}
+
 #endif
@@ -0,0 +1,94 @@
+#ifndef CACHE_MT_CPP
+#define CACHE_MT_CPP
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include "../Include/sharded-cache.hpp"
+#include "../Include/buffered-cache.hpp"
+#include "../Include/trace-reader.hpp"
+
+struct ReplayResult
+{
+    double mreq_per_sec;
+    double hit_ratio;
+};
+
+// replays the trace by n_threads threads, each one takes every n_threads-th request
+template <typename CacheT>
+ReplayResult replay(CacheT& cache, const std::vector<int>& page_keys, size_t n_threads)
+{
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t t = 0; t < n_threads; t++)
+        threads.emplace_back([&cache, &page_keys, t, n_threads]()
+        {
+            for (size_t i = t; i < page_keys.size(); i += n_threads)
+                cache.update(page_keys[i]);
+        });
+
+    for (size_t t = 0; t < n_threads; t++) threads[t].join();
+
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+    typename CacheT::Stats stats = cache.stats();
+    double n_requests = stats.hits + stats.misses;
+
+    return { n_requests / time.count() / 1e6, (n_requests > 0) ? stats.hits / n_requests : 0.0 };
+}
+
+// compares ShardedCache and BufferedCache on the trace by 1, 2, 4 ... 64 threads;
+// usage: cache_mt [n_shards] [trace.txt], the trace is read from stdin if no file is given
+int main(int argc, char* argv[])
+{
+    size_t n_shards = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 64;
+
+    size_t cache_size = 0;
+    size_t n_page     = 0;
+    std::vector<int> page_keys;
+
+    try
+    {
+        TraceReader trace((argc > 2) ? argv[2] : nullptr);
+
+        if (!trace.next(cache_size) || !trace.next(n_page))
+        {
+            std::cerr << "trace has to start with cache size and number of pages\n";
+            return 1;
+        }
+
+        page_keys.resize(n_page);
+        if (trace.read(page_keys.data(), n_page) != n_page)
+        {
+            std::cerr << "trace is shorter than " << n_page << " pages\n";
+            return 1;
+        }
+    }
+    catch (const std::exception& error)
+    {
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+
+    std::cout << "threads   sharded Mreq/s   hit ratio   buffered Mreq/s   hit ratio\n";
+
+    for (size_t n_threads = 1; n_threads <= 64; n_threads *= 2)
+    {
+        ShardedCache<int>  sharded(cache_size, n_shards);
+        BufferedCache<int> buffered(cache_size);
+
+        ReplayResult s = replay(sharded,  page_keys, n_threads);
+        ReplayResult b = replay(buffered, page_keys, n_threads);
+
+        fprintf(stdout, "%7zu %16.2f %11.4f %17.2f %11.4f\n", n_threads,
+                s.mreq_per_sec, s.hit_ratio, b.mreq_per_sec, b.hit_ratio);
+    }
+
+    return 0;
+}
+
+#endif
@@ -2,41 +2,1650 @@
 #define TEST_CPP
 
 #include <iostream>
-#include <fstream>
 #include <cassert>
+#include <random>
+#include <list>
+#include <map>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
 #include "../Include/perfect-cache.hpp"
+#include "../Include/external-perfect-cache.hpp"
 #include "../Include/LFU-cache.hpp"
+#include "../Include/sharded-cache.hpp"
+#include "../Include/buffered-cache.hpp"
+#include "../Include/weighted-cache.hpp"
+#include "../Include/expiring-cache.hpp"
+#include "../Include/trace-reader.hpp"
+#include "../Include/workload.hpp"
+#include "../Include/miss-ratio-curve.hpp"
+#include "../Include/dense-keys.hpp"
+#include "../Include/static-cache.hpp"
+#include "../Include/cache-hierarchy.hpp"
+
+// straightforward Belady simulation to check perfect_cache_hits against
+static int naive_perfect_cache_hits(size_t cache_size, const std::vector<int>& page_keys)
+{
+    int hits = 0;
+    std::vector<int> cache;
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        if (std::find(cache.begin(), cache.end(), page_keys[i]) != cache.end()) { hits++; continue; }
+        if (cache_size == 0) continue;
+        if (cache.size() < cache_size) { cache.push_back(page_keys[i]); continue; }
+
+        size_t victim = 0, max_dist = 0;
+        for (size_t j = 0; j < cache.size(); j++)
+        {
+            size_t next = std::find(page_keys.begin() + i + 1, page_keys.end(), cache[j]) - page_keys.begin();
+            if (next > max_dist) { max_dist = next; victim = j; }
+        }
+
+        cache[victim] = page_keys[i];
+    }
+
+    return hits;
+}
+
+// straightforward LFU simulation, ties between the least frequent pages go to the least recently used one
+static size_t naive_lfu_hits(size_t cache_size, const std::vector<int>& page_keys)
+{
+    struct Page { int key; size_t freq; size_t last_use; };
+
+    size_t hits = 0;
+    std::vector<Page> cache;
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        auto page = std::find_if(cache.begin(), cache.end(), [&](const Page& p) { return p.key == page_keys[i]; });
+
+        if (page != cache.end())
+        {
+            hits++;
+            page->freq++;
+            page->last_use = i;
+            continue;
+        }
+
+        if (cache_size == 0) continue;
+
+        if (cache.size() == cache_size)
+            cache.erase(std::min_element(cache.begin(), cache.end(), [](const Page& a, const Page& b)
+                        { return (a.freq != b.freq) ? (a.freq < b.freq) : (a.last_use < b.last_use); }));
+
+        cache.push_back({page_keys[i], 1, i});
+    }
+
+    return hits;
+}
+
+// LFU that halves all frequencies at once every aging_period requests, pages are kept in the order of
+// eviction: by frequency, and pages of the same frequency by the order before halving and then by recency
+static size_t naive_aged_lfu_hits(size_t cache_size, size_t aging_period, const std::vector<int>& page_keys)
+{
+    struct Page { int key; size_t freq; };
+
+    size_t hits = 0;
+    std::list<Page> cache;
+
+    // put page after all pages that are not more frequent
+    auto place = [&](Page page)
+    {
+        auto it = cache.end();
+        while (it != cache.begin() && std::prev(it)->freq > page.freq) --it;
+        cache.insert(it, page);
+    };
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        if ((i + 1) % aging_period == 0)
+            for (Page& page : cache) page.freq = std::max<size_t>(page.freq / 2, 1);
+
+        auto page = std::find_if(cache.begin(), cache.end(), [&](const Page& p) { return p.key == page_keys[i]; });
+
+        if (page != cache.end())
+        {
+            hits++;
+            Page hit = {page->key, page->freq + 1};
+            cache.erase(page);
+            place(hit);
+            continue;
+        }
+
+        if (cache.size() == cache_size) cache.pop_front();
+        place({page_keys[i], 1});
+    }
+
+    return hits;
+}
+
+// straightforward LRU simulation
+static size_t naive_lru_hits(size_t cache_size, const std::vector<int>& page_keys)
+{
+    size_t hits = 0;
+    std::list<int> cache;   // the most recently used page is at front
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        auto page = std::find(cache.begin(), cache.end(), page_keys[i]);
+
+        if (page != cache.end())
+        {
+            hits++;
+            cache.erase(page);
+        }
+        else if (cache_size == 0) continue;
+        else if (cache.size() == cache_size) cache.pop_back();
+
+        cache.push_front(page_keys[i]);
+    }
+
+    return hits;
+}
+
+// straightforward 2Q simulation following the paper of Johnson and Shasha
+static size_t naive_2q_hits(size_t cache_size, const std::vector<int>& page_keys)
+{
+    size_t hits = 0;
+    size_t kin  = std::max<size_t>(cache_size / 4, 1);
+    size_t kout = std::max<size_t>(cache_size / 2, 1);
+
+    std::list<int> a1in, am, a1out; // new pages are pushed to front
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        int key = page_keys[i];
+
+        auto page = std::find(am.begin(), am.end(), key);
+        if (page != am.end())
+        {
+            hits++;
+            am.erase(page);
+            am.push_front(key);
+            continue;
+        }
+
+        if (std::find(a1in.begin(), a1in.end(), key) != a1in.end()) { hits++; continue; }
+        if (cache_size == 0) continue;
+
+        auto ghost  = std::find(a1out.begin(), a1out.end(), key);
+        bool to_am  = (ghost != a1out.end());
+        if (to_am) a1out.erase(ghost);
+
+        if (a1in.size() + am.size() == cache_size)
+        {
+            if (a1in.size() > kin || am.empty())
+            {
+                a1out.push_front(a1in.back());
+                a1in.pop_back();
+                if (a1out.size() > kout) a1out.pop_back();
+            }
+            else am.pop_back();
+        }
+
+        (to_am ? am : a1in).push_front(key);
+    }
+
+    return hits;
+}
+
+// straightforward ARC simulation following the paper of Megiddo and Modha
+static size_t naive_arc_hits(size_t cache_size, const std::vector<int>& page_keys)
+{
+    size_t hits = 0;
+    size_t c = cache_size, p = 0;
+
+    std::list<int> t1, t2, b1, b2;  // the most recent page is at front
+
+    auto contains = [](std::list<int>& l, int key) { return std::find(l.begin(), l.end(), key) != l.end(); };
+
+    auto replace = [&](bool in_b2)
+    {
+        if (!t1.empty() && ((in_b2 && t1.size() == p) || t1.size() > p || t2.empty()))
+        {
+            b1.push_front(t1.back());
+            t1.pop_back();
+        }
+        else
+        {
+            b2.push_front(t2.back());
+            t2.pop_back();
+        }
+    };
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        int key = page_keys[i];
+
+        if (contains(t1, key) || contains(t2, key))
+        {
+            hits++;
+            t1.remove(key);
+            t2.remove(key);
+            t2.push_front(key);
+            continue;
+        }
+
+        if (c == 0) continue;
+
+        if (contains(b1, key))
+        {
+            p = std::min(c, p + std::max<size_t>(b2.size() / b1.size(), 1));
+            replace(false);
+            b1.remove(key);
+            t2.push_front(key);
+            continue;
+        }
+
+        if (contains(b2, key))
+        {
+            p -= std::min(p, std::max<size_t>(b1.size() / b2.size(), 1));
+            replace(true);
+            b2.remove(key);
+            t2.push_front(key);
+            continue;
+        }
+
+        size_t l1 = t1.size() + b1.size();
+
+        if (l1 == c)
+        {
+            if (t1.size() < c)
+            {
+                b1.pop_back();
+                replace(false);
+            }
+            else t1.pop_back();
+        }
+        else if (l1 + t2.size() + b2.size() >= c)
+        {
+            if (l1 + t2.size() + b2.size() == 2 * c) b2.pop_back();
+            replace(false);
+        }
+
+        t1.push_front(key);
+    }
+
+    return hits;
+}
+
+// straightforward GDSF simulation of pages weighing weight_of(key), capacity is the total weight;
+// ties between the least priorities go to the least recently used page
+static size_t naive_gdsf_hits(size_t capacity, const std::vector<int>& page_keys, size_t (*weight_of)(int))
+{
+    struct Page { int key; size_t freq; size_t weight; double priority; size_t last_use; };
+
+    size_t hits = 0, total = 0, clock = 0;
+    double inflation = 0;
+    std::vector<Page> cache;
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        auto page = std::find_if(cache.begin(), cache.end(), [&](const Page& p) { return p.key == page_keys[i]; });
+
+        if (page != cache.end())
+        {
+            hits++;
+            page->freq++;
+            page->priority = inflation + double(page->freq) / double(page->weight);
+            page->last_use = clock++;
+            continue;
+        }
+
+        size_t weight = weight_of(page_keys[i]);
+        if (weight > capacity) continue;
+
+        while (total + weight > capacity)
+        {
+            auto victim = std::min_element(cache.begin(), cache.end(), [](const Page& a, const Page& b)
+                          { return (a.priority != b.priority) ? (a.priority < b.priority) : (a.last_use < b.last_use); });
+
+            inflation = victim->priority;
+            total    -= victim->weight;
+            cache.erase(victim);
+        }
+
+        cache.push_back({page_keys[i], 1, weight, inflation + 1 / double(weight), clock++});
+        total += weight;
+    }
+
+    return hits;
+}
+
+static size_t unit_weight(int) { return 1; }
+
+static size_t page_weight(int key) { return 1 + key * 37 % 50; }
+
+static size_t naive_unit_gdsf_hits(size_t cache_size, const std::vector<int>& page_keys)
+{
+    return naive_gdsf_hits(cache_size, page_keys, unit_weight);
+}
+
+// LFU of naive_lfu_hits whose pages expire: a request at times[i] first drops every page whose
+// deadline has come, a missed page gets the deadline times[i] + ttls[i]
+static size_t naive_expiring_lfu_hits(size_t cache_size, const std::vector<int>& page_keys,
+                                      const std::vector<uint64_t>& times, const std::vector<uint64_t>& ttls)
+{
+    struct Page { int key; size_t freq; size_t last_use; uint64_t deadline; };
+
+    size_t hits = 0;
+    std::vector<Page> cache;
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        cache.erase(std::remove_if(cache.begin(), cache.end(), [&](const Page& p) { return p.deadline <= times[i]; }),
+                    cache.end());
+
+        auto page = std::find_if(cache.begin(), cache.end(), [&](const Page& p) { return p.key == page_keys[i]; });
+
+        if (page != cache.end())
+        {
+            hits++;
+            page->freq++;
+            page->last_use = i;
+            continue;
+        }
+
+        if (cache_size == 0) continue;
+
+        if (cache.size() == cache_size)
+            cache.erase(std::min_element(cache.begin(), cache.end(), [](const Page& a, const Page& b)
+                        { return (a.freq != b.freq) ? (a.freq < b.freq) : (a.last_use < b.last_use); }));
+
+        cache.push_back({page_keys[i], 1, i, times[i] + ttls[i]});
+    }
+
+    return hits;
+}
+
+static std::vector<int> random_trace(std::mt19937& gen, size_t max_keys, int max_distinct)
+{
+    size_t n_keys     = gen() % max_keys;
+    int    n_distinct = 1 + gen() % max_distinct;
+
+    std::vector<int> page_keys(n_keys);
+    for (size_t i = 0; i < n_keys; i++) page_keys[i] = gen() % n_distinct;
+
+    return page_keys;
+}
+
+// compares Cache_t with the policy against its naive simulation on a random trace
+template <template <typename> class PolicyT>
+static bool test_policy(size_t test_number, size_t (*naive_hits)(size_t, const std::vector<int>&))
+{
+    std::mt19937 gen(test_number);
+
+    size_t cache_size = gen() % 16;
+    std::vector<int> page_keys = random_trace(gen, 500, 40);
+
+    Cache_t<int, int, PolicyT> cache(cache_size);
+
+    size_t hits = 0;
+    for (size_t i = 0; i < page_keys.size(); i++)
+        if (cache.update(page_keys[i])) ++hits;
+
+    size_t result = naive_hits(cache_size, page_keys);
+
+    if (hits == result) return true;
+
+    std::cout << ">>> ERROR: expected " << result << ", recieved " << hits << "\n";
+    return false;
+}
+
+// FlatIndex has to give the same results as std::unordered_map, including after its tombstones are dropped
+static bool test_flat_index()
+{
+    std::mt19937 gen(0);
+    bool ok = true;
+
+    for (size_t cache_size : {1, 11, 89, 700})
+    {
+        Cache_t<int, int, LFU, StdIndex<int>>  std_cache(cache_size);
+        Cache_t<int, int, LFU, FlatIndex<int>> flat_cache(cache_size);
+
+        for (size_t i = 0; i < 200000; i++)
+        {
+            int key = gen() % (3 * cache_size + 5);
+
+            if (gen() % 7 == 0) ok = ok && (std_cache.erase(key)  == flat_cache.erase(key));
+            else                ok = ok && (std_cache.update(key) == flat_cache.update(key));
+        }
+    }
+
+    if (!ok) std::cout << ">>> ERROR: FlatIndex differs from StdIndex\n";
+    return ok;
+}
+
+// cache of dense ids has to give the same results as the cache of the keys they replace
+static bool test_dense_index()
+{
+    std::mt19937 gen(0);
+    bool ok = true;
+
+    for (size_t cache_size : {1, 11, 89, 700})
+    {
+        std::vector<int> page_keys(200000);
+        for (int& key : page_keys) key = int(gen() % (3 * cache_size + 5)) * 7919 - 1000000;
+
+        DenseTrace<int> trace = remap_dense(page_keys);
+
+        Cache_t<int, int, LFU>                            cache(cache_size);
+        Cache_t<int, uint32_t, LFU, DenseIndex<uint32_t>> dense_cache(cache_size);
+
+        for (size_t i = 0; i < page_keys.size(); i++)
+        {
+            ok = ok && (trace.ids[i] < trace.universe()) && (trace.keys[trace.ids[i]] == page_keys[i]);
+
+            if (gen() % 7 == 0) ok = ok && (cache.erase(page_keys[i])  == dense_cache.erase(trace.ids[i]));
+            else                ok = ok && (cache.update(page_keys[i]) == dense_cache.update(trace.ids[i]));
+        }
+    }
+
+    if (!ok) std::cout << ">>> ERROR: DenseIndex differs from FlatIndex\n";
+    return ok;
+}
+
+// a full cache of int keys has to take less than 24 bytes per page besides keys and values
+static bool test_metadata_size()
+{
+    const size_t cache_size = 1000000;
+
+    Cache_t<int> cache(cache_size);
+    for (size_t i = 0; i < 2 * cache_size; i++) cache.update(i % (cache_size + cache_size / 2));
+
+    double bytes_per_page = double(cache.metadata_bytes()) / cache_size;
+    if (bytes_per_page < 24) return true;
+
+    std::cout << ">>> ERROR: " << bytes_per_page << " bytes per page\n";
+    return false;
+}
+
+// count-min sketch with conservative update never underestimates a frequency before halving
+static bool test_frequency_sketch()
+{
+    const size_t cache_size = 1000;
+
+    std::mt19937 gen(7);
+    FrequencySketch<int> sketch(cache_size);
+    std::vector<size_t> counts(2 * cache_size);
+
+    // fewer requests than a sample, so counters aren't halved
+    for (size_t i = 0; i < 5 * cache_size; i++)
+    {
+        int key = gen() % counts.size();
+        sketch.increment(key);
+        counts[key]++;
+    }
+
+    size_t error = 0;
+
+    for (size_t key = 0; key < counts.size(); key++)
+    {
+        size_t estimate = sketch.estimate(key);
+
+        if (estimate < std::min<size_t>(counts[key], 16))
+        {
+            std::cout << ">>> ERROR: key " << key << " requested " << counts[key] << " times, estimated " << estimate << "\n";
+            return false;
+        }
+
+        error += estimate - std::min<size_t>(counts[key], estimate);
+    }
+
+    if (error < counts.size() / 4) return true;
+
+    std::cout << ">>> ERROR: overestimated by " << double(error) / counts.size() << " per key\n";
+    return false;
+}
+
+// hot pages requested in every round have to survive scans of unique pages between rounds
+static bool test_tinylfu_scan()
+{
+    const size_t cache_size = 100;
+
+    Cache_t<int, int, WTinyLFU> tinylfu(cache_size);
+    Cache_t<int, int, LRU>      lru    (cache_size);
+
+    size_t tinylfu_hits = 0, lru_hits = 0, requests = 0;
+    int    scan_key     = 1000;
+
+    for (size_t round = 0; round < 100; round++)
+    {
+        for (int key = 0; key < 80; key++, requests++)
+        {
+            tinylfu_hits += tinylfu.update(key);
+            lru_hits     += lru    .update(key);
+        }
+
+        for (size_t i = 0; i < 2 * cache_size; i++, requests++, scan_key++)
+        {
+            tinylfu_hits += tinylfu.update(scan_key);
+            lru_hits     += lru    .update(scan_key);
+        }
+    }
+
+    std::cout << "(W-TinyLFU " << tinylfu_hits << ", LRU " << lru_hits << " of " << requests << ") ";
+
+    // all hot requests but those of the first round hit
+    if (tinylfu_hits >= 99 * 80 * 9 / 10) return true;
+
+    std::cout << ">>> ERROR: too few hits\n";
+    return false;
+}
+
+// aging that finishes an epoch on the request that starts it has to match the naive one
+static bool test_lfu_aging(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    size_t cache_size   = 1 + gen() % 16;
+    size_t aging_period = 1 + gen() % 30;
+    std::vector<int> page_keys = random_trace(gen, 500, 40);
+
+    Cache_t<int, int, LFU> cache(cache_size, aging_period, SIZE_MAX);
+
+    size_t hits = 0;
+    for (size_t i = 0; i < page_keys.size(); i++)
+        if (cache.update(page_keys[i])) ++hits;
+
+    size_t result = naive_aged_lfu_hits(cache_size, aging_period, page_keys);
+
+    if (hits == result) return true;
+
+    std::cout << ">>> ERROR: expected " << result << ", recieved " << hits << "\n";
+    return false;
+}
+
+// aging spread over requests with the least step: requested pages have to stay in the cache,
+// and erasing all of them walks every bucket and slot link
+static bool test_lfu_incremental_aging(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    size_t cache_size   = 1 + gen() % 64;
+    size_t aging_period = 1 + gen() % 30;
+    std::vector<int> page_keys = random_trace(gen, 2000, 100);
+
+    Cache_t<int, int, LFU> cache(cache_size, aging_period, 1);
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        cache.update(page_keys[i]);
+
+        if (!cache.peek(page_keys[i]))
+        {
+            std::cout << ">>> ERROR: key " << page_keys[i] << " isn't cached after request " << i << "\n";
+            return false;
+        }
+    }
+
+    size_t erased = 0;
+    for (int key = 0; key < 100; key++) erased += cache.erase(key);
+
+    if (cache.hash_t_.size() == 0 && erased <= cache_size) return true;
+
+    std::cout << ">>> ERROR: erased " << erased << " pages of " << cache_size << "\n";
+    return false;
+}
+
+// after the hot set changes, aged LFU has to forget the old one and cache the new one
+static bool test_lfu_drift()
+{
+    const size_t cache_size = 100;
+
+    Cache_t<int, int, LFU> plain(cache_size);
+    Cache_t<int, int, LFU> aged (cache_size, 1000);
+
+    size_t plain_hits = 0, aged_hits = 0;
+
+    for (int phase = 0; phase < 2; phase++)
+        for (size_t round = 0; round < 100; round++)
+            for (int key = phase * 1000; key < phase * 1000 + int(cache_size); key++)
+            {
+                bool plain_hit = plain.update(key);
+                bool aged_hit  = aged .update(key);
+
+                if (phase == 0) continue;
+
+                plain_hits += plain_hit;
+                aged_hits  += aged_hit;
+            }
+
+    std::cout << "(hits after the shift: aged " << aged_hits << ", plain " << plain_hits << ") ";
+
+    if (aged_hits > 50 * cache_size && plain_hits < 10 * cache_size) return true;
+
+    std::cout << ">>> ERROR: aging doesn't adapt\n";
+    return false;
+}
+
+// a mapped file has to be parsed whatever whitespace separates numbers and a bad number has to be reported
+static bool test_trace_file()
+{
+    const char* path = "trace_reader_test.txt";
+
+    FILE* file = fopen(path, "w");
+    fputs("3\t5\r\n-1  20000000000\n\n 7 +8", file);
+    fclose(file);
+
+    long long values[8] = {};
+    size_t n = 0;
+    bool bad_number = false;
+
+    try
+    {
+        TraceReader trace(path);
+        n = trace.read(values, 8);
+    }
+    catch (const std::runtime_error&) { bad_number = true; }
+
+    remove(path);
+
+    if (bad_number && values[2] == -1 && values[3] == 20000000000LL && values[4] == 7) return true;
+
+    std::cout << ">>> ERROR: read " << n << " numbers\n";
+    return false;
+}
+
+// feeds pieces to standard input through a pipe, pausing after each one, so that a reader blocked on
+// the pipe gets the pieces as separate chunks; returns the numbers read from it
+static std::vector<int> read_pipe(const std::vector<std::string>& pieces, size_t max_keys)
+{
+    std::vector<int> keys(max_keys);
+
+    int fds[2];
+    if (pipe(fds) < 0) return {};
+
+    int saved_stdin = dup(STDIN_FILENO);
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+
+    std::thread writer([&]
+    {
+        for (const std::string& piece : pieces)
+        {
+            for (size_t done = 0; done < piece.size();)
+            {
+                ssize_t n = write(fds[1], piece.data() + done, piece.size() - done);
+                if (n <= 0) break;
+                done += n;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        close(fds[1]);
+    });
+
+    size_t n = 0;
+    try
+    {
+        TraceReader trace;
+        n = trace.read(keys.data(), max_keys);
+    }
+    catch (const std::runtime_error& error) { std::cout << ">>> ERROR: " << error.what() << "\n"; }
+
+    writer.join();
+    dup2(saved_stdin, STDIN_FILENO);
+    close(saved_stdin);
+
+    keys.resize(n);
+    return keys;
+}
+
+// numbers cut by the ends of chunks of a pipe have to be read whole,
+// as well as the last number if the trace ends right after its last digit
+static bool test_trace_pipe(bool trailing_space)
+{
+    const size_t n_keys = 1000000;
+
+    std::string text;
+    for (size_t i = 0; i < n_keys; i++) text += std::to_string(i * 7919 % 1000003) + ((i % 10) ? " " : "\n");
+    if (!trailing_space) text.pop_back();
+
+    std::vector<std::string> pieces;
+    for (size_t done = 0; done < text.size(); done += 65537) pieces.push_back(text.substr(done, 65537));
+
+    std::vector<int> keys = read_pipe(pieces, n_keys + 1);
+
+    if (keys.size() != n_keys)
+    {
+        std::cout << ">>> ERROR: read " << keys.size() << " of " << n_keys << " numbers\n";
+        return false;
+    }
+
+    for (size_t i = 0; i < n_keys; i++)
+        if (keys[i] != int(i * 7919 % 1000003))
+        {
+            std::cout << ">>> ERROR: number " << i << " is " << keys[i] << "\n";
+            return false;
+        }
+
+    return true;
+}
+
+// a negative number cut right after its sign by the end of a chunk has to be read whole
+static bool test_trace_pipe_sign()
+{
+    std::vector<int> keys = read_pipe({ "5 -", "324 -7 -", "1" }, 5);
+
+    if (keys == std::vector<int>{ 5, -324, -7, -1 }) return true;
+
+    std::cout << ">>> ERROR: read " << keys.size() << " numbers\n";
+    return false;
+}
+
+// frequencies of Zipf ranks have to follow 1 / rank^alpha
+static bool test_zipf_generator()
+{
+    const size_t n = 1000, n_samples = 1000000;
+    const double alpha = 0.99;
+
+    std::mt19937_64 gen(1);
+    ZipfGenerator zipf(n, alpha);
+    std::vector<size_t> counts(n);
+
+    for (size_t i = 0; i < n_samples; i++) counts[zipf(gen)]++;
+
+    double norm = 0;
+    for (size_t rank = 1; rank <= n; rank++) norm += std::pow(rank, -alpha);
+
+    for (size_t rank : {1, 2, 10, 100})
+    {
+        double expected = n_samples * std::pow(rank, -alpha) / norm;
+
+        if (std::fabs(counts[rank - 1] - expected) > 0.05 * expected)
+        {
+            std::cout << ">>> ERROR: rank " << rank << " drawn " << counts[rank - 1] << " times, expected " << expected << "\n";
+            return false;
+        }
+    }
+
+    return make_workload(Workload::HOTSPOT, 1000, 10, 5) == make_workload(Workload::HOTSPOT, 1000, 10, 5);
+}
+
+// curves have to match separate simulations of every capacity
+static bool test_hits_curves(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    size_t max_capacity = gen() % 20;
+    std::vector<int> page_keys = random_trace(gen, 500, 40);
+
+    std::vector<size_t> lru = lru_hits_curve(page_keys, max_capacity);
+    std::vector<size_t> opt = opt_hits_curve(page_keys, max_capacity);
+
+    for (size_t c = 0; c <= max_capacity; c++)
+    {
+        size_t lru_result = naive_lru_hits(c, page_keys);
+        size_t opt_result = perfect_cache_hits(c, page_keys.size(), page_keys);
+
+        if (lru[c] != lru_result || opt[c] != opt_result)
+        {
+            std::cout << ">>> ERROR: capacity " << c << ": expected LRU " << lru_result << ", OPT " << opt_result
+                      << ", recieved LRU " << lru[c] << ", OPT " << opt[c] << "\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// SHARDS sampling a tenth of keys has to stay close to the exact LRU curve; skewed traces are the hard case
+// for sampling by keys, as whether a few hottest keys are sampled changes a lot of requests
+static bool test_shards()
+{
+    const size_t max_capacity = 10000;
+
+    std::vector<int> page_keys = make_workload(Workload::ZIPF, 1000000, max_capacity, 3);
+
+    std::vector<size_t> exact  = lru_hits_curve(page_keys, max_capacity);
+    std::vector<double> approx = shards_lru_hits_curve(page_keys, max_capacity, 0.1);
+
+    double error = 0;
+    for (size_t c = 1; c <= max_capacity; c++) error += std::fabs(exact[c] - approx[c]) / page_keys.size();
+
+    error /= max_capacity;
+    std::cout << "(mean absolute error " << error << ") ";
+
+    if (error < 0.03) return true;
+
+    std::cout << ">>> ERROR: SHARDS curve is too far from the exact one\n";
+    return false;
+}
+
+// batches have to give the same hits as requests one by one, both for small caches and for ones that prefetch
+template <template <typename> class PolicyT>
+static bool test_update_batch()
+{
+    for (size_t cache_size : {100, 100000})
+    {
+        std::vector<int> page_keys = make_workload(Workload::ZIPF, 500000, cache_size, cache_size, 0.8);
+
+        Cache_t<int, int, PolicyT> single(cache_size);
+        Cache_t<int, int, PolicyT> batched(cache_size);
+
+        std::unique_ptr<bool[]> hits(new bool[page_keys.size()]);
+
+        for (size_t done = 0; done < page_keys.size(); done += 1000)
+            batched.update_batch(&page_keys[done], std::min<size_t>(1000, page_keys.size() - done), &hits[done]);
+
+        for (size_t i = 0; i < page_keys.size(); i++)
+            if (single.update(page_keys[i]) != hits[i])
+            {
+                std::cout << ">>> ERROR: capacity " << cache_size << ", request " << i << " differs\n";
+                return false;
+            }
+    }
+
+    return true;
+}
+
+static bool test_perfect_cache(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    size_t cache_size = gen() % 8;
+    std::vector<int> page_keys = random_trace(gen, 300, 20);
+
+    int hits   = perfect_cache_hits(cache_size, page_keys.size(), page_keys);
+    int result = naive_perfect_cache_hits(cache_size, page_keys);
+
+    if (hits == result) return true;
+
+    std::cout << ">>> ERROR: expected " << result << ", recieved " << hits << "\n";
+    return false;
+}
+
+// OPT of dense ids has to match OPT of the original keys
+static bool test_dense_perfect_cache(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    size_t cache_size = gen() % 8;
+    std::vector<int> page_keys = random_trace(gen, 300, 20);
+
+    DenseTrace<int> trace = remap_dense(page_keys);
+
+    size_t hits   = dense_perfect_cache_hits(cache_size, trace.ids, trace.universe());
+    size_t result = perfect_cache_hits(cache_size, page_keys.size(), page_keys);
+
+    if (hits == result) return true;
+
+    std::cout << ">>> ERROR: expected " << result << ", recieved " << hits << "\n";
+    return false;
+}
+
+// out of core perfect cache with tiny chunks has to match the in-memory one,
+// on traces of few keys and on scans where most keys are requested once
+static bool test_external_perfect_cache(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    size_t cache_size = gen() % 16;
+    std::vector<int> page_keys = random_trace(gen, 500, (test_number % 2) ? 40 : 1000);
+
+    ExternalPerfectCache<int> cache(1 + gen() % 10);
+    for (size_t done = 0; done < page_keys.size(); done += 13)
+        cache.push(&page_keys[done], std::min<size_t>(13, page_keys.size() - done));
+
+    size_t hits   = cache.hits(cache_size);
+    size_t result = perfect_cache_hits(cache_size, page_keys.size(), page_keys);
+
+    if (hits == result) return true;
+
+    std::cout << ">>> ERROR: expected " << result << ", recieved " << hits << "\n";
+    return false;
+}
+
+// every value has to fall into a bucket whose bounds hold it, and percentiles have to be within a bucket
+static bool test_latency_histogram()
+{
+    const uint64_t values[] = { 0, 1, 15, 16, 17, 31, 32, 1000, 123456789, UINT64_MAX };
+    bool ok = true;
+
+    for (uint64_t value : values)
+    {
+        unsigned bucket = LatencyHistogram::bucket(value);
+        ok = ok && (bucket < LatencyHistogram::BUCKETS) &&
+             (LatencyHistogram::lower_bound(bucket) <= value) && (value <= LatencyHistogram::upper_bound(bucket));
+    }
+
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 10000; value++) histogram.record(value);
+
+    uint64_t p50 = histogram.percentile(0.5), p99 = histogram.percentile(0.99);
+
+    ok = ok && (histogram.count() == 10000) && (histogram.min() == 1) && (histogram.max() == 10000) &&
+         (p50 >= 5000) && (p50 <= 5000 + 5000 / LatencyHistogram::SUB) &&
+         (p99 >= 9900) && (histogram.percentile(1) == 10000);
+
+    if (!ok) std::cout << ">>> ERROR: wrong buckets or percentiles\n";
+    return ok;
+}
+
+#ifdef CACHE_STATS
+// counters of a cache have to add up to the requests, and every operation has to take its latency
+static bool test_cache_stats()
+{
+    Cache_t<int, int, ARC> cache(10);
+    std::mt19937 gen(0);
+
+    for (size_t i = 0; i < 10000; i++) cache.update(gen() % 30);
+    cache.put(100, 1);
+    cache.find(100);
+    cache.erase(100);
+
+    CacheStats stats = cache.stats();
+
+    bool ok = (stats.hits + stats.misses == 10002) && (stats.insertions == stats.misses) &&
+              (stats.evictions + 10 == stats.insertions) && (stats.erasures == 1) &&
+              (stats.policy.promotions + stats.policy.splices == stats.hits) &&
+              (stats.update_ns.count() == 10000) && (stats.put_ns.count() == 1) && (stats.find_ns.count() == 1) &&
+              (stats.erase_ns.count() == 1) && (cache.stats_json().find("\"hits\": ") != std::string::npos);
+
+    if (!ok) std::cout << ">>> ERROR: counters don't add up\n";
+    return ok;
+}
+#endif
+
+// WeightedCache with GDSF against its naive simulation, the total weight must never exceed the capacity
+static bool test_weighted_gdsf(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    size_t capacity = gen() % 300;
+    std::vector<int> page_keys = random_trace(gen, 500, 40);
+
+    WeightedCache<int> cache(capacity, 64);
+
+    size_t hits = 0;
+    bool   fits = true;
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        if (cache.update(page_keys[i], page_weight(page_keys[i]))) ++hits;
+        fits = fits && (cache.weight() <= capacity);
+    }
+
+    size_t result = naive_gdsf_hits(capacity, page_keys, page_weight);
+
+    if (hits == result && fits) return true;
+
+    std::cout << ">>> ERROR: expected " << result << ", recieved " << hits << (fits ? "" : ", capacity exceeded") << "\n";
+    return false;
+}
+
+// large pages requested once must not push out small pages requested often: every round requests all
+// small pages and ten new large ones, which is more than the capacity, so LRU never hits a small page
+static bool test_gdsf_small_pages()
+{
+    const size_t capacity = 1 << 20, small = 1000, large = 100000;
+    const int    n_small  = 100;
+
+    WeightedCache<int, int, GDSF> gdsf(capacity, 1000);
+    WeightedCache<int, int, LRU>  lru (capacity, 1000);
+
+    size_t gdsf_hits = 0, lru_hits = 0, n_requests = 0;
+    int    large_key = n_small;
+
+    for (int round = 0; round < 100; round++)
+        for (int key = 0; key < n_small; key++, n_requests++)
+        {
+            gdsf_hits += gdsf.update(key, small);
+            lru_hits  += lru .update(key, small);
+
+            if (key % 10 != 9) continue;
+
+            gdsf.update(large_key, large);
+            lru .update(large_key, large);
+            large_key++;
+        }
+
+    bool ok = (gdsf_hits > 0.95 * n_requests) && (lru_hits < 0.05 * n_requests);
+
+    if (!ok) std::cout << ">>> ERROR: small pages hit " << gdsf_hits << " times with GDSF and " << lru_hits << " with LRU\n";
+    return ok;
+}
+
+// get() and put() of a weighted cache, a page heavier than the capacity is returned but not cached
+static bool test_weighted_get_put()
+{
+    WeightedCache<std::string> cache(10, 8);
+    size_t n_loads = 0;
+
+    auto loader = [&n_loads](int key) { ++n_loads; return std::make_pair(std::to_string(key), size_t(key)); };
+
+    bool ok = (cache.get(4, loader) == "4") && (cache.get(4, loader) == "4") && (n_loads == 1);
+    ok = ok && (cache.get(11, loader) == "11") && (cache.find(11) == nullptr) && (cache.weight() == 4);
+
+    ok = ok && !cache.put(5, "five", 5) && (cache.weight() == 9);
+    ok = ok && cache.put(5, "5", 6) && (*cache.find(5) == "5") && (cache.weight() <= 10);
+    ok = ok && cache.erase(5) && !cache.erase(5) && (cache.weight() == cache.size() * 4);
+
+    if (!ok) std::cout << ">>> ERROR: wrong values or weights in get/put/erase\n";
+    return ok;
+}
+
+// clock of tests, moved by hand
+struct TestClock
+{
+    const uint64_t* time;
+    uint64_t now() const { return *time; }
+};
+
+// timer wheel has to expire every slot exactly once, at the first advance not earlier than its deadline,
+// whether time moves by a tick or jumps over several levels
+static bool test_timer_wheel(size_t test_number)
+{
+    std::mt19937_64 gen(test_number);
+
+    const uint32_t n_slots = 200;
+    uint64_t now = gen() % 1000000;
+
+    TimerWheel wheel(n_slots, now);
+    std::map<uint32_t, uint64_t> deadlines;
+    bool ok = true;
+
+    for (size_t step = 0; step < 2000 && ok; step++)
+    {
+        uint32_t slot = gen() % n_slots;
+
+        switch (gen() % 4)
+        {
+            case 0:
+            {
+                if (wheel.scheduled(slot)) break;
+
+                int      scale    = gen() % 7;
+                uint64_t deadline = now + 1 + gen() % (uint64_t(1) << (scale * 7));
+                wheel.schedule(slot, deadline);
+                deadlines[slot] = deadline;
+                break;
+            }
+            case 1:
+                wheel.cancel(slot);
+                deadlines.erase(slot);
+                break;
+            default:
+            {
+                int scale = gen() % 6;
+                now += gen() % (uint64_t(1) << (scale * 8));
+
+                wheel.advance(now, [&](uint32_t expired)
+                {
+                    auto it = deadlines.find(expired);
+                    ok = ok && (it != deadlines.end()) && (it->second <= now) && !wheel.scheduled(expired);
+                    if (it != deadlines.end()) deadlines.erase(it);
+                });
+
+                for (auto& deadline : deadlines) ok = ok && (deadline.second > now) && wheel.scheduled(deadline.first);
+            }
+        }
+    }
+
+    if (!ok) std::cout << ">>> ERROR: slot expired at wrong time\n";
+    return ok;
+}
+
+// ExpiringCache against naive LFU with deadlines on a random trace with random times to live
+static bool test_expiring_cache(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    size_t cache_size = gen() % 16;
+    std::vector<int> page_keys = random_trace(gen, 500, 40);
+
+    std::vector<uint64_t> times(page_keys.size()), ttls(page_keys.size());
+    uint64_t time = 0;
+
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        time   += (gen() % 4 == 0) ? gen() % 100 : 0;
+        times[i] = time;
+        ttls [i] = 1 + gen() % 200;
+    }
+
+    uint64_t now = 0;
+    ExpiringCache<int, int, LFU, TestClock> cache(cache_size, TestClock{&now});
+
+    size_t hits = 0;
+    for (size_t i = 0; i < page_keys.size(); i++)
+    {
+        now = times[i];
+        if (cache.update(page_keys[i], ttls[i])) ++hits;
+    }
+
+    size_t result = naive_expiring_lfu_hits(cache_size, page_keys, times, ttls);
+
+    if (hits == result) return true;
+
+    std::cout << ">>> ERROR: expected " << result << ", recieved " << hits << "\n";
+    return false;
+}
+
+// an expired page has to give its slot to a new one before the least frequent live page is evicted
+static bool test_expired_first()
+{
+    uint64_t now = 0;
+    ExpiringCache<std::string, int, LFU, TestClock> cache(2, TestClock{&now});
+
+    cache.put(1, "one", 10);
+    cache.put(2, "two");
+    cache.find(1);
+    cache.find(1);
+
+    bool ok = (cache.peek(1) != nullptr);
+
+    now = 10;
+    ok = ok && (cache.peek(1) == nullptr);
+
+    cache.put(3, "three", 5);
+    ok = ok && (cache.expired() == 1) && cache.find(2) && cache.find(3) && (cache.find(1) == nullptr);
+
+    now = 1000000000;
+    ok = ok && (cache.find(3) == nullptr) && cache.find(2) && (cache.size() == 1);
+
+    // the deadline of a page may pass while the value of a missed one is loaded
+    now = 0;
+    ExpiringCache<std::string, int, LFU, TestClock> loading(2, TestClock{&now});
+
+    loading.put(1, "one", 5);
+    loading.put(2, "two");
+    for (int i = 0; i < 3; i++) loading.find(1);
+
+    now = 4;
+    auto slow_loader = [&now](int key) { now = 10; return std::to_string(key); };
+    ok = ok && (loading.get(3, slow_loader) == "3") && (loading.expired() == 1) && (loading.size() == 2);
+    ok = ok && loading.peek(2) && loading.peek(3) && (loading.peek(1) == nullptr);
+
+    if (!ok) std::cout << ">>> ERROR: live page evicted before the expired one\n";
+    return ok;
+}
+
+// a page with ttl 0, or one whose deadline the clock passes while it's loaded, has to expire at once
+// without evicting a live page, and a put with such ttl has to drop the cached page
+static bool test_expire_at_once()
+{
+    uint64_t now = 100;
+    ExpiringCache<std::string, int, LFU, TestClock> cache(1, TestClock{&now});
+
+    cache.put(1, "one");
+
+    bool ok = !cache.put(2, "two", 0) && !cache.update(3, 0) && (cache.size() == 1) && cache.peek(1);
+
+    auto slow_loader = [&now](int key) { now += 10; return std::to_string(key); };
+    ok = ok && (cache.get(4, slow_loader, 5) == "4") && (cache.peek(4) == nullptr) && cache.peek(1);
+
+    ok = ok && cache.put(1, "one again", 0) && (cache.peek(1) == nullptr) && (cache.size() == 0);
+    ok = ok && (cache.expired() == 4);
+
+    now = 1000000;
+    ok = ok && (cache.get(5, slow_loader, 20) == "5") && (cache.size() == 1) && cache.peek(5);
+
+    if (!ok) std::cout << ">>> ERROR: page that expired at once is cached\n";
+    return ok;
+}
+
+static std::string read_file(const char* path)
+{
+    std::string data;
+    FILE* file = fopen(path, "rb");
+    if (!file) return data;
+
+    char buffer[4096];
+    for (size_t n = 0; (n = fread(buffer, 1, sizeof(buffer), file)) > 0;) data.append(buffer, n);
+
+    fclose(file);
+    return data;
+}
+
+// the order of eviction has to be restored exactly: a loaded cache saves the same snapshot, and without aging,
+// whose period starts anew, it gives the same hits as the saved one from then on; a snapshot of other values is refused
+template <template <typename> class PolicyT, typename... Args>
+static bool test_snapshot(size_t test_number, Args... policy_args)
+{
+    const char* path   = "cache_snapshot_test.bin";
+    const char* resave = "cache_snapshot_test_2.bin";
+
+    std::mt19937 gen(test_number);
+
+    size_t cache_size = 1 + gen() % 16;
+    std::vector<int> page_keys = random_trace(gen, 500, 40);
+
+    Cache_t<long, int, PolicyT> saved(cache_size, policy_args...);
+    for (size_t i = 0; i < page_keys.size() / 2; i++) saved.put(page_keys[i], 3L * page_keys[i]);
+
+    saved.save(path);
+
+    Cache_t<long, int, PolicyT> loaded(cache_size, policy_args...);
+    loaded.load(path);
+    loaded.save(resave);
+
+    bool ok = (read_file(path) == read_file(resave));
+
+    for (size_t i = page_keys.size() / 2; i < page_keys.size() && sizeof...(Args) == 0; i++)
+    {
+        const long* saved_value  = saved .peek(page_keys[i]);
+        const long* loaded_value = loaded.peek(page_keys[i]);
+
+        ok = ok && (!saved_value == !loaded_value) && (!saved_value || *saved_value == *loaded_value) &&
+             (saved.update(page_keys[i]) == loaded.update(page_keys[i]));
+    }
+
+    bool refused = false;
+    try { Cache_t<int, int, PolicyT>(cache_size).load(path); }
+    catch (const std::runtime_error&) { refused = true; }
+
+    remove(path);
+    remove(resave);
+
+    if (ok && refused) return true;
+
+    std::cout << ">>> ERROR: " << (ok ? "snapshot of another type is loaded" : "loaded cache differs") << "\n";
+    return false;
+}
+
+// get() has to load a page only on a miss and keep values of cached pages
+static bool test_get_put()
+{
+    Cache_t<std::string> cache(2);
+    size_t n_loads = 0;
+
+    auto loader = [&n_loads](int key) { ++n_loads; return std::to_string(key); };
+
+    bool ok = (cache.get(1, loader) == "1") && (cache.get(1, loader) == "1") && (n_loads == 1);
+
+    cache.put(2, "two");
+    ok = ok && (cache.get(2, loader) == "two") && (cache.get(1, loader) == "1") && (n_loads == 1);
+
+    cache.get(3, loader);   // evicts page 2 that has lower frequency than page 1
+    ok = ok && (cache.find(2) == nullptr) && (cache.find(1) != nullptr);
+
+    ok = ok && cache.erase(3) && !cache.erase(3) && (cache.find(3) == nullptr);
+    ok = ok && !cache.put(4, "four") && cache.put(4, "4") && (*cache.find(4) == "4");
+
+    if (!ok) std::cout << ">>> ERROR: wrong values in get/put/erase\n";
+    return ok;
+}
+
+// the same get/put/erase scenario as test_get_put() on StaticCache
+static bool test_static_get_put()
+{
+    StaticCache<std::string, int, 2> cache;
+    size_t n_loads = 0;
+
+    auto loader = [&n_loads](int key) { ++n_loads; return std::to_string(key); };
+
+    bool ok = (cache.get(1, loader) == "1") && (cache.get(1, loader) == "1") && (n_loads == 1);
+
+    cache.put(2, "two");
+    ok = ok && (cache.get(2, loader) == "two") && (cache.get(1, loader) == "1") && (n_loads == 1);
+
+    cache.get(3, loader);   // evicts page 2 that has lower frequency than page 1
+    ok = ok && (cache.find(2) == nullptr) && (cache.find(1) != nullptr);
+
+    ok = ok && cache.erase(3) && !cache.erase(3) && (cache.find(3) == nullptr) && (cache.size() == 1);
+    ok = ok && !cache.put(4, "four") && cache.put(4, "4") && (*cache.find(4) == "4") && (*cache.peek(1) == "1");
+
+    // hits reorder pages, but a reference has to keep pointing to the value of its page
+    StaticCache<std::string, int, 4> stable;
+    std::string& first = stable.get(1, loader);
+
+    for (int key : { 2, 2, 1, 3, 1, 4 }) stable.get(key, loader);
+    stable.erase(3);
+    ok = ok && (first == "1") && (&first == stable.peek(1));
+
+    if (!ok) std::cout << ">>> ERROR: wrong values in get/put/erase of StaticCache\n";
+    return ok;
+}
+
+// StaticCache has to match Cache_t with LFU operation by operation, with erasures moving pages around
+template <typename KeyT, size_t N>
+static bool test_static_cache(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    StaticCache<int, KeyT, N> cache;
+    Cache_t<int, KeyT, LFU>   lfu(N);
+    bool ok = true;
+
+    for (size_t i = 0; i < 3000 && ok; i++)
+    {
+        KeyT key   = KeyT(gen() % (3 * N + 2)) * 1000003;
+        int  value = gen() % 100;
+
+        switch (gen() % 10)
+        {
+            case 0:  ok = (cache.erase(key) == lfu.erase(key));               break;
+            case 1:  ok = (cache.put(key, value) == lfu.put(key, value));     break;
+            case 2:  ok = (cache.get(key, [&](KeyT) { return value; }) ==
+                           lfu  .get(key, [&](KeyT) { return value; }));      break;
+            default: ok = (cache.update(key) == lfu.update(key));             break;
+        }
+
+        const int* a = cache.peek(key);
+        const int* b = lfu  .peek(key);
+        ok = ok && (cache.size() <= N) && (!a == !b) && (!a || *a == *b);
+    }
+
+    if (!ok) std::cout << ">>> ERROR: StaticCache differs from Cache_t\n";
+    return ok;
+}
+
+// capacity has to be split between shards evenly and statistics of all shards have to add up
+static bool test_sharded_split()
+{
+    ShardedCache<int> uneven(10, 3), single(5, 0), tiny(2, 4);
+
+    bool ok = (uneven.n_shards() == 3) && (single.n_shards() == 1) && (tiny.n_shards() == 4);
+    ok = ok && (uneven.shard_capacity(0) == 4) && (uneven.shard_capacity(1) == 3) && (uneven.shard_capacity(2) == 3);
+    ok = ok && (single.shard_capacity(0) == 5);
+    ok = ok && (tiny.shard_capacity(0) == 1) && (tiny.shard_capacity(1) == 1) && (tiny.shard_capacity(3) == 0);
+
+    // every shard holds far more than its share of 50 keys, so the second pass hits everywhere
+    ShardedCache<int> cache(400, 4);
+    for (int pass = 0; pass < 2; pass++)
+        for (int key = 0; key < 50; key++) cache.update(key);
+
+    ok = ok && (cache.get(0, [](int k) { return k; }) == 0) && (cache.get(1000, [](int k) { return k; }) == 1000);
+
+    ShardedCache<int>::Stats stats = cache.stats();
+    ok = ok && (stats.hits == 51) && (stats.misses == 51);
+
+    if (!ok) std::cout << ">>> ERROR: wrong capacities of shards or statistics\n";
+    return ok;
+}
+
+// several threads read the same pages, every value has to be right and every request counted
+template <typename CacheT>
+static bool test_concurrent_cache()
+{
+    const size_t n_threads = 4, n_requests = 20000;
+
+    CacheT cache(50);
+    std::atomic<bool> ok(true);
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < n_threads; t++)
+        threads.emplace_back([&cache, &ok, t]()
+        {
+            std::mt19937 gen(t);
+
+            for (size_t i = 0; i < n_requests; i++)
+            {
+                int key = gen() % 100;
+                if (cache.get(key, [](int k) { return 2 * k; }) != 2 * key) ok = false;
+            }
+        });
+
+    for (size_t t = 0; t < n_threads; t++) threads[t].join();
+
+    typename CacheT::Stats stats = cache.stats();
+    if (stats.hits + stats.misses != n_threads * n_requests) ok = false;
+
+    if (!ok) std::cout << ">>> ERROR: wrong values or statistics\n";
+    return ok;
+}
+
+static CacheHierarchy<int> make_hierarchy(const char* policy_1, size_t capacity_1, const char* policy_2, size_t capacity_2,
+                                          Inclusion inclusion)
+{
+    std::vector<std::unique_ptr<CacheLevel<int>>> levels;
+    levels.push_back(make_cache_level<int>(policy_1, capacity_1));
+    levels.push_back(make_cache_level<int>(policy_2, capacity_2));
+
+    return CacheHierarchy<int>(std::move(levels), { 1, 10 }, 100, inclusion);
+}
+
+// exclusive LRU levels of a and b pages hold the top a and the next b pages of one LRU stack,
+// so together they hit exactly as LRU of a + b pages, and no page is in both of them
+static bool test_exclusive_hierarchy(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    size_t capacity_1 = gen() % 6, capacity_2 = gen() % 10;
+    std::vector<int> page_keys = random_trace(gen, 500, 40);
+
+    CacheHierarchy<int> hierarchy = make_hierarchy("lru", capacity_1, "lru", capacity_2, Inclusion::EXCLUSIVE);
+
+    size_t hits = 0;
+    bool   ok   = true;
+
+    for (int key : page_keys)
+    {
+        hits += hierarchy.update(key) < hierarchy.n_levels();
+
+        for (int page = 0; page < 40; page++)
+            ok = ok && !(hierarchy.level(0).contains(page) && hierarchy.level(1).contains(page));
+    }
+
+    size_t result = naive_lru_hits(capacity_1 + capacity_2, page_keys);
+    ok = ok && (hits == result) && (hits + hierarchy.misses() == page_keys.size());
+
+    if (!ok) std::cout << ">>> ERROR: expected " << result << " hits of disjoint levels, recieved " << hits << "\n";
+    return ok;
+}
+
+// every page of the first level has to be in the second one, the first level has to hit as a lone cache,
+// and the latency has to be the mean of the costs of levels looked into and of the backend
+static bool test_inclusive_hierarchy(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    size_t capacity_1 = gen() % 6, capacity_2 = capacity_1 + gen() % 10;
+    std::vector<int> page_keys = random_trace(gen, 500, 40);
+
+    CacheHierarchy<int> hierarchy = make_hierarchy("lfu", capacity_1, "lru", capacity_2, Inclusion::INCLUSIVE);
+    Cache_t<int, int, LFU> lone(capacity_1);
+
+    double latency = 0;
+    bool   ok      = true;
+
+    for (int key : page_keys)
+    {
+        // a page the second level evicts is taken out of the first one, so the first level
+        // hits as a lone cache only until the second one is full
+        bool alone = hierarchy.level(1).size() < capacity_2;
+
+        size_t level = hierarchy.update(key);
+        latency += (level == 0) ? 1 : (level == 1) ? 11 : 111;
+
+        if (alone) ok = ok && (lone.update(key) == (level == 0));
+
+        for (int page = 0; page < 40; page++)
+            ok = ok && (!hierarchy.level(0).contains(page) || hierarchy.level(1).contains(page));
+    }
+
+    ok = ok && (std::fabs(hierarchy.average_latency() - latency / page_keys.size()) < 1e-9);
+
+    if (!ok) std::cout << ">>> ERROR: inclusive hierarchy lost a page of the first level or its latency\n";
+    return ok;
+}
+
+// a hierarchy without levels has to send every request to the backend in both modes
+static bool test_empty_hierarchy()
+{
+    bool ok = true;
+
+    for (Inclusion inclusion : { Inclusion::INCLUSIVE, Inclusion::EXCLUSIVE })
+    {
+        CacheHierarchy<int> hierarchy({}, {}, 100, inclusion);
+
+        for (int key : { 1, 2, 1 }) ok = ok && (hierarchy.update(key) == 0);
+        ok = ok && (hierarchy.misses() == 3) && (hierarchy.average_latency() == 100);
+    }
+
+    if (!ok) std::cout << ">>> ERROR: hierarchy without levels has a page\n";
+    return ok;
+}
+
+// buffered hits are applied before every eviction, so a lone thread has to hit exactly as Cache_t with LFU
+static bool test_buffered_lfu(size_t test_number)
+{
+    std::mt19937 gen(test_number);
+
+    size_t cache_size = gen() % 16;
+    std::vector<int> page_keys = random_trace(gen, 500, 40);
+
+    BufferedCache<int> buffered(cache_size);
+    Cache_t<int>       lone(cache_size);
+
+    for (int key : page_keys)
+        if (buffered.update(key) != lone.update(key))
+        {
+            std::cout << ">>> ERROR: buffered cache hits differ from LFU\n";
+            return false;
+        }
+
+    return true;
+}
+
+// readers have to see whole values while other threads put, erase and evict the pages they read
+static bool test_buffered_writers()
+{
+    const size_t n_threads = 4, n_requests = 20000;
+
+    BufferedCache<std::string> cache(20);
+    std::atomic<bool> ok(true);
+    std::vector<std::thread> threads;
+
+    for (size_t t = 0; t < n_threads; t++)
+        threads.emplace_back([&cache, &ok, t]()
+        {
+            std::mt19937 gen(t);
+
+            for (size_t i = 0; i < n_requests; i++)
+            {
+                int key = gen() % 50;
+
+                switch (gen() % 8)
+                {
+                    case 0:  cache.put(key, std::to_string(key)); break;
+                    case 1:  cache.erase(key);                    break;
+                    default: if (cache.get(key, [](int k) { return std::to_string(k); }) != std::to_string(key)) ok = false;
+                }
+            }
+        });
+
+    for (size_t t = 0; t < n_threads; t++) threads[t].join();
+
+    if (!ok) std::cout << ">>> ERROR: wrong value read while pages were written\n";
+    return ok;
+}
+
+// threads missing the same key at once have to share one load, while the shard serves other keys;
+// a failed load is thrown to every waiter and the next request loads again, and a page put during
+// the load isn't overwritten by it
+static bool test_single_flight()
+{
+    const size_t n_threads = 8;
+
+    ShardedCache<int> cache(10, 1);     // one shard, so every key takes the lock of the loaded one
+    std::atomic<size_t> n_loads(0), n_failures(0);
+    std::atomic<bool>   release(false), ok(true);
+
+    auto wait_release = [&]() { while (!release) std::this_thread::yield(); };
+    auto slow_loader  = [&](int key) { n_loads++; wait_release(); return 2 * key; };
+    auto fast_loader  = [&](int key) { n_loads++; return 2 * key; };
+    auto fail_loader  = [&](int) -> int { n_loads++; wait_release(); throw std::runtime_error("backend is down"); };
+
+    // waits until n requests have missed or joined a load
+    auto wait_requests = [&](size_t n)
+    {
+        for (;;)
+        {
+            ShardedCache<int>::Stats stats = cache.stats();
+            if (stats.misses + stats.coalesced >= n) return;
+            std::this_thread::yield();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < n_threads; t++)
+        threads.emplace_back([&]() { if (cache.get_or_load(7, slow_loader) != 14) ok = false; });
+
+    wait_requests(n_threads);
+    ok = ok && (cache.get_or_load(8, fast_loader) == 16);    // the shard isn't locked by the load
+    release = true;
+
+    for (std::thread& thread : threads) thread.join();
+    threads.clear();
+
+    ok = ok && (n_loads == 2) && (cache.get_or_load(7, fast_loader) == 14) && (n_loads == 2);
+
+    release = false;
+    for (size_t t = 0; t < n_threads; t++)
+        threads.emplace_back([&]()
+        {
+            try              { cache.get_or_load(9, fail_loader); ok = false; }
+            catch (const std::runtime_error&) { n_failures++; }
+        });
+
+    wait_requests(2 * n_threads + 1);
+    release = true;
+
+    for (std::thread& thread : threads) thread.join();
+    threads.clear();
+
+    ok = ok && (n_loads == 3) && (n_failures == n_threads) && (cache.get_or_load(9, fast_loader) == 18) && (n_loads == 4);
+
+    release = false;
+    threads.emplace_back([&]() { if (cache.get_or_load(5, slow_loader) != 10) ok = false; });
+
+    wait_requests(2 * n_threads + 3);
+    cache.put(5, 100);
+    release = true;
+
+    threads[0].join();
+
+    ShardedCache<int>::Stats stats = cache.stats();
+    ok = ok && (cache.get_or_load(5, fast_loader) == 100) && (n_loads == 5) && (stats.coalesced == 2 * n_threads - 2);
+
+    if (!ok) std::cout << ">>> ERROR: concurrent misses weren't coalesced into one load\n";
+    return ok;
+}
+
+static void report(bool ok, size_t& correct_tests)
+{
+    if (!ok) return;
+
+    std::cout << ">>> SUCCESS\n";
+    ++correct_tests;
+}
 
 int main()
 {
-    std::ifstream test_data("../Test/test_data.txt");
-    assert(test_data.good());
+    TraceReader test_data("../Test/test_data.txt");
 
     size_t test_number = 0;
     size_t correct_tests = 0;
     size_t cache_size = 0;
 
-    while (test_data >> cache_size)
+    while (test_data.next(cache_size))
     {
         Cache_t<int> cache(cache_size);
 
         std::cout << "\n" << "TEST #" << ++test_number << " ";
 
-        size_t n_keys;
-        test_data >> n_keys;
+        size_t n_keys = 0;
+        test_data.next(n_keys);
 
         int key;
         size_t hits = 0;
 
         while (n_keys--)
         {
-            test_data >> key;
+            test_data.next(key);
             if (cache.update(key)) ++hits;
             // cache.dump();
         }
 
-        size_t result;
-        test_data >> result;
+        size_t result = 0;
+        test_data.next(result);
 
         if (hits == result)
         {
@@ -47,6 +1656,167 @@ int main()
             std::cout << ">>> ERROR: expected " << result << ", recieved " << hits << "\n";
     }
 
+    std::cout << "\n" << "TEST #" << ++test_number << " (get/put) ";
+    report(test_get_put(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (weighted get/put) ";
+    report(test_weighted_get_put(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (GDSF keeps small pages) ";
+    report(test_gdsf_small_pages(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (expired pages go first) ";
+    report(test_expired_first(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (expire at once) ";
+    report(test_expire_at_once(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (latency histogram) ";
+    report(test_latency_histogram(), correct_tests);
+
+#ifdef CACHE_STATS
+    std::cout << "\n" << "TEST #" << ++test_number << " (cache stats) ";
+    report(test_cache_stats(), correct_tests);
+#endif
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (flat index) ";
+    report(test_flat_index(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (static cache get/put) ";
+    report(test_static_get_put(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (dense index) ";
+    report(test_dense_index(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (metadata size) ";
+    report(test_metadata_size(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (frequency sketch) ";
+    report(test_frequency_sketch(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (W-TinyLFU scan) ";
+    report(test_tinylfu_scan(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (LFU aging on drift) ";
+    report(test_lfu_drift(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (trace file) ";
+    report(test_trace_file(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (trace pipe) ";
+    report(test_trace_pipe(true), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (trace pipe without trailing space) ";
+    report(test_trace_pipe(false), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (trace pipe with sign cut off) ";
+    report(test_trace_pipe_sign(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (zipf generator) ";
+    report(test_zipf_generator(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (SHARDS) ";
+    report(test_shards(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (LFU update batch) ";
+    report(test_update_batch<LFU>(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (LRU update batch) ";
+    report(test_update_batch<LRU>(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (W-TinyLFU update batch) ";
+    report(test_update_batch<WTinyLFU>(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (sharded cache split) ";
+    report(test_sharded_split(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (sharded cache) ";
+    report(test_concurrent_cache<ShardedCache<int>>(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (single-flight loads) ";
+    report(test_single_flight(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (buffered cache) ";
+    report(test_concurrent_cache<BufferedCache<int>>(), correct_tests);
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (buffered cache writers) ";
+    report(test_buffered_writers(), correct_tests);
+
+    for (size_t i = 0; i < 100; i++)
+    {
+        std::cout << "\n" << "TEST #" << ++test_number << " (random LFU) ";
+        report(test_policy<LFU>(i, naive_lfu_hits), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (random aged LFU) ";
+        report(test_lfu_aging(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (incremental LFU aging) ";
+        report(test_lfu_incremental_aging(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (timer wheel) ";
+        report(test_timer_wheel(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (random expiring LFU) ";
+        report(test_expiring_cache(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (LFU snapshot) ";
+        report(test_snapshot<LFU>(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (aged LFU snapshot) ";
+        report(test_snapshot<LFU>(i, size_t(20)), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (LRU snapshot) ";
+        report(test_snapshot<LRU>(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (random static cache) ";
+        report(test_static_cache<int, 1>(i) && test_static_cache<int, 7>(i) && test_static_cache<int, 64>(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (random static cache of 64-bit keys) ";
+        report(test_static_cache<int64_t, 13>(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (random LRU) ";
+        report(test_policy<LRU>(i, naive_lru_hits), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (random GDSF) ";
+        report(test_policy<GDSF>(i, naive_unit_gdsf_hits), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (random weighted GDSF) ";
+        report(test_weighted_gdsf(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (random 2Q) ";
+        report(test_policy<TwoQ>(i, naive_2q_hits), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (random ARC) ";
+        report(test_policy<ARC>(i, naive_arc_hits), correct_tests);
+    }
+
+    std::cout << "\n" << "TEST #" << ++test_number << " (empty hierarchy) ";
+    report(test_empty_hierarchy(), correct_tests);
+
+    for (size_t i = 0; i < 100; i++)
+    {
+        std::cout << "\n" << "TEST #" << ++test_number << " (perfect cache) ";
+        report(test_perfect_cache(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (dense perfect cache) ";
+        report(test_dense_perfect_cache(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (buffered cache as LFU) ";
+        report(test_buffered_lfu(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (external perfect cache) ";
+        report(test_external_perfect_cache(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (exclusive hierarchy) ";
+        report(test_exclusive_hierarchy(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (inclusive hierarchy) ";
+        report(test_inclusive_hierarchy(i), correct_tests);
+
+        std::cout << "\n" << "TEST #" << ++test_number << " (hits curves) ";
+        report(test_hits_curves(i), correct_tests);
+    }
+
     std::cout << "\n========================================================= \n\n"
             << "CORRECT TESTS: " << correct_tests << " / " << test_number << "\n\n";
 